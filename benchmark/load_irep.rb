@@ -0,0 +1,44 @@
+# Load time of a large .mrb (run with CRuby from the top directory)
+#
+#   ruby benchmark/load_irep.rb [nireps] [runs]
+#
+# Generates a program with a few thousand ireps, compiles it with
+# bin/mrbc and times `bin/mruby -b`, which goes through
+# mrb_read_irep_file().  The best time of an empty program is
+# subtracted from the best time of the large one.
+
+require 'tmpdir'
+
+NIREP = (ARGV[0] || 4000).to_i
+RUNS  = (ARGV[1] || 20).to_i
+MRBC  = File.expand_path('../../bin/mrbc', __FILE__)
+MRUBY = File.expand_path('../../bin/mruby', __FILE__)
+
+def compile(dir, name, src)
+  rb = File.join(dir, "#{name}.rb")
+  File.write(rb, src)
+  system(MRBC, '-g', rb) or abort "mrbc failed"
+  File.join(dir, "#{name}.mrb")
+end
+
+def measure(mrb)
+  RUNS.times.map {
+    t = Time.now
+    system(MRUBY, '-b', mrb) or abort "mruby failed"
+    Time.now - t
+  }.min
+end
+
+Dir.mktmpdir do |dir|
+  src = (0...NIREP / 10).map { |c|
+    "class Load#{c % 10}\n" +
+    (0...9).map { |m| "  def m#{c}_#{m}(a, b=#{m}); [a, b, :s#{c}_#{m}, 'str#{m}', #{c}.#{m}]; end\n" }.join +
+    "end\n"
+  }.join
+  big = compile(dir, 'big', src)
+  empty = compile(dir, 'empty', "nil\n")
+
+  base = measure(empty)
+  t = measure(big)
+  printf("%d ireps, %d bytes: %.3f ms/load\n", NIREP, File.size(big), (t - base) * 1000)
+end
@@ -14,6 +14,16 @@ MRuby::Build.new do |conf|
   # include the default GEMs
   conf.gembox 'default'
 
+  # mark with worker threads in full GC (see GC.mark_workers; needs pthreads)
+  # conf.cc.defines << 'MRB_GC_PARALLEL_MARK'
+  # conf.linker.libraries << 'pthread'
+  # sweep heap pages on a helper thread (see GC.concurrent_sweep; needs
+  # pthreads and a thread safe allocf)
+  # conf.cc.defines << 'MRB_GC_CONCURRENT_SWEEP'
+  # take heap pages from mmap'ed chunks instead of allocf (see
+  # GC.trim_threshold; needs mmap)
+  # conf.cc.defines << 'MRB_GC_MMAP_PAGES'
+
   # C compiler settings
   # conf.cc do |cc|
   #   cc.command = ENV['CC'] || 'gcc'
@@ -67,6 +77,14 @@ MRuby::Build.new do |conf|
   # conf.file_separator = '/'
 end
 
+# Build used for tests: the default gems plus those only tested here
+MRuby::Build.new('test') do |conf|
+  toolchain :gcc
+
+  conf.gembox 'default'
+  conf.gem :core => "mruby-eval"
+end
+
 # Define cross build settings
 # MRuby::CrossBuild.new('32bit') do |conf|
 #   toolchain :gcc
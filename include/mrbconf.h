@@ -32,6 +32,21 @@
 /* number of object per heap page */
 //#define MRB_HEAP_PAGE_SIZE 1024
 
+/* alignment of heap pages in bytes; a power of two not less than a page
+   (MRB_HEAP_PAGE_SIZE objects plus the page header).  By default the
+   page size rounded up to a power of two */
+//#define MRB_HEAP_PAGE_ALIGN 65536
+
+/* mark with worker threads in full GC (requires pthreads) */
+//#define MRB_GC_PARALLEL_MARK
+
+/* sweep on a helper thread (requires pthreads and a thread safe allocf) */
+//#define MRB_GC_CONCURRENT_SWEEP
+
+/* allocate heap pages from mmap'ed chunks, not through allocf, and trim
+   them (requires mmap) */
+//#define MRB_GC_MMAP_PAGES
+
 /* use segmented list for IV table */
 //#define MRB_USE_IV_SEGLIST
 
@@ -67,6 +67,44 @@ enum gc_state {
   GC_STATE_SWEEP
 };
 
+/* GC phase transitions reported to mrb_gc_set_event_hook() */
+enum mrb_gc_event {
+  MRB_GC_EVENT_START,           /* a cycle starts with the root scan */
+  MRB_GC_EVENT_MARK_END,        /* marking is done; sweeping starts */
+  MRB_GC_EVENT_END              /* the cycle is complete */
+};
+
+/* collector statistics; see GC.stat and GC.latest_info */
+struct mrb_gc_stat {
+  size_t count;                 /* cycles started */
+  size_t minor_count;
+  size_t major_count;
+  size_t total_allocated_objects;
+  size_t total_freed_objects;
+  uint64_t mark_time_ns;
+  uint64_t sweep_time_ns;
+  uint64_t max_pause_ns;        /* longest single GC call */
+  /* the latest cycle */
+  mrb_bool latest_major:1;
+  mrb_bool latest_full:1;       /* started by mrb_garbage_collect */
+  mrb_bool latest_open:1;       /* not complete yet */
+  size_t latest_live_after_mark;
+  size_t latest_freed;
+  uint64_t latest_mark_time_ns;
+  uint64_t latest_sweep_time_ns;
+  uint64_t latest_max_pause_ns;
+};
+
+/* heap slot sizes; see gc_size_class() in gc.c */
+#define MRB_GC_SIZE_CLASSES 3
+
+/* growable stack of objects waiting to be traversed by the GC */
+struct mrb_gray_stack {
+  struct RBasic **objs;
+  size_t len;
+  size_t capa;
+};
+
 typedef struct mrb_state {
   void *jmp;
 
@@ -88,6 +126,11 @@ typedef struct mrb_state {
 
   struct mrb_irep **irep;
   size_t irep_len, irep_capa;
+  size_t irep_old_len; /* leading ireps whose pool literals are all old */
+  size_t irep_free;    /* slots below irep_len freed with their unit */
+  struct rite_load_ctx *irep_images; /* images of lazily loaded ireps */
+  struct mrb_archive *archives;      /* open bytecode archives */
+  struct mrb_code_cache *code_cache; /* compiled eval sources */
 
   mrb_sym init_sym;
   struct RObject *top_self;
@@ -106,18 +149,28 @@ typedef struct mrb_state {
   struct RClass *nil_class;
   struct RClass *symbol_class;
   struct RClass *kernel_module;
+  int bop_redefined; /* MRB_BOP_* flags; basic operators redefined */
+
+  struct mrb_class_display *class_displays; /* ancestry per class serial */
+  int class_displays_len;
+  int class_displays_capa;
+  int class_displays_free;
 
   struct heap_page *heaps;
   struct heap_page *sweeps;
-  struct heap_page *free_heaps;
+  struct heap_page *free_heaps[MRB_GC_SIZE_CLASSES]; /* pages with free slots */
+  struct gc_sweep_job *sweep_job; /* background sweep in progress */
+  struct heap_chunk *heap_chunks; /* mmap'ed page chunks */
+  size_t heap_pages;            /* pages in use */
   size_t live; /* count of live objects */
   struct RBasic *arena[MRB_ARENA_SIZE];
   int arena_idx;
 
   enum gc_state gc_state; /* state of gc */
   int current_white_part; /* make white object by white_part */
-  struct RBasic *gray_list; /* list of gray objects */
-  struct RBasic *variable_gray_list; /* list of objects to be traversed atomically */
+  struct mrb_gray_stack gray_stack; /* gray objects */
+  struct mrb_gray_stack variable_gray_stack; /* objects to be traversed atomically */
+  mrb_bool gray_overflow:1;     /* gray objects left off a full stack */
   size_t gc_live_after_mark;
   size_t gc_threshold;
   int gc_interval_ratio;
@@ -126,7 +179,20 @@ typedef struct mrb_state {
   mrb_bool gc_full:1;
   mrb_bool is_generational_gc_mode:1;
   mrb_bool out_of_memory:1;
+  mrb_bool gc_concurrent_sweep:1;
   size_t majorgc_old_threshold;
+  size_t malloc_increase;       /* bytes allocated since last GC cycle */
+  size_t malloc_increase_old;   /* bytes allocated since last major GC */
+  size_t malloc_bytes[MRB_TT_MAXDEFINE]; /* bytes allocated per owner type */
+  int gc_malloc_ratio;          /* allocated bytes counted as one slot */
+  int gc_step_budget_us;        /* max incremental step time; 0 uses gc_step_ratio */
+  size_t gc_step_chunk;         /* objects processed between clock checks */
+  int gc_mark_workers;          /* marker threads used by full GC */
+  size_t gc_huge_page_threshold; /* heap pages before chunks use huge pages */
+  size_t gc_trim_threshold;     /* free pages kept before chunks are trimmed */
+  struct mrb_gc_stat gc_stat;
+  void (*gc_event_hook)(struct mrb_state *mrb, enum mrb_gc_event event, void *ud);
+  void *gc_event_ud;
   struct alloca_header *mems;
 
   mrb_sym symidx;
@@ -150,6 +216,8 @@ mrb_value mrb_singleton_class(mrb_state*, mrb_value);
 void mrb_include_module(mrb_state*, struct RClass*, struct RClass*);
 
 void mrb_define_method(mrb_state*, struct RClass*, const char*, mrb_func_t, mrb_aspec);
+/* leaf methods take no arguments and never raise, yield or call back into Ruby */
+void mrb_define_leaf_method(mrb_state*, struct RClass*, const char*, mrb_func_t);
 void mrb_define_class_method(mrb_state *, struct RClass *, const char *, mrb_func_t, mrb_aspec);
 void mrb_define_singleton_method(mrb_state*, struct RObject*, const char*, mrb_func_t, mrb_aspec);
 void mrb_define_module_function(mrb_state*, struct RClass*, const char*, mrb_func_t, mrb_aspec);
@@ -201,6 +269,58 @@ struct RClass * mrb_define_module_under(mrb_state *mrb, struct RClass *outer, co
 
 int mrb_get_args(mrb_state *mrb, const char *format, ...);
 
+/* arguments converted according to a precompiled mrb_argspec */
+typedef union mrb_arg {
+  mrb_value v;                              /* o S A H & */
+  mrb_int i;                                /* i */
+  mrb_float f;                              /* f */
+  mrb_bool b;                               /* b */
+  mrb_sym n;                                /* n */
+  struct { char *ptr; int len; } s;         /* s z */
+  struct { mrb_value *ptr; mrb_int len; } a; /* a * */
+} mrb_arg;
+
+typedef mrb_value (*mrb_argfunc_t)(mrb_state *mrb, mrb_value self, mrb_arg *argv, int argc);
+/* converts one argument into its slot, like an mrb_get_args() specifier */
+typedef void (*mrb_argconv_t)(mrb_state *mrb, mrb_value v, mrb_arg *arg);
+
+void mrb_argconv_str(mrb_state*, mrb_value, mrb_arg*);     /* S */
+void mrb_argconv_ary(mrb_state*, mrb_value, mrb_arg*);     /* A */
+void mrb_argconv_hash(mrb_state*, mrb_value, mrb_arg*);    /* H */
+void mrb_argconv_strptr(mrb_state*, mrb_value, mrb_arg*);  /* s */
+void mrb_argconv_cstr(mrb_state*, mrb_value, mrb_arg*);    /* z */
+void mrb_argconv_aryptr(mrb_state*, mrb_value, mrb_arg*);  /* a */
+void mrb_argconv_float(mrb_state*, mrb_value, mrb_arg*);   /* f */
+void mrb_argconv_int(mrb_state*, mrb_value, mrb_arg*);     /* i */
+void mrb_argconv_bool(mrb_state*, mrb_value, mrb_arg*);    /* b */
+void mrb_argconv_sym(mrb_state*, mrb_value, mrb_arg*);     /* n */
+
+#define MRB_ARGSPEC_MAX 16
+
+/*
+  argument signature of a method, fixed at compile time.  argv gets
+  req + opt converted arguments, then the rest as in '*' when rest is
+  set, then the block when block is set.  conv holds one converter per
+  required and optional argument; NULL takes the value as is, like 'o'.
+  Specs are const and shared by every mrb_state.
+ */
+typedef struct mrb_argspec {
+  mrb_argfunc_t func;
+  unsigned char req;
+  unsigned char opt;
+  unsigned char rest;
+  unsigned char block;
+  mrb_argconv_t conv[MRB_ARGSPEC_MAX];
+} mrb_argspec;
+
+/* e.g. "S|i&" is MRB_ARGSPEC(f, 1, 1, 0, 1, mrb_argconv_str, mrb_argconv_int) */
+#define MRB_ARGSPEC(func, req, opt, rest, block, ...) \
+  { (func), (req), (opt), (rest), (block), { __VA_ARGS__ } }
+
+void mrb_define_method_spec(mrb_state*, struct RClass*, const char*, const mrb_argspec*);
+int mrb_get_args_spec(mrb_state *mrb, const mrb_argspec *spec, mrb_arg *argv);
+mrb_value mrb_argspec_call(mrb_state *mrb, const mrb_argspec *spec, mrb_value self);
+
 mrb_value mrb_funcall(mrb_state*, mrb_value, const char*, int,...);
 mrb_value mrb_funcall_argv(mrb_state*, mrb_value, mrb_sym, int, mrb_value*);
 mrb_value mrb_funcall_with_block(mrb_state*, mrb_value, mrb_sym, int, mrb_value*, mrb_value);
@@ -225,6 +345,7 @@ mrb_sym mrb_intern(mrb_state *mrb,const char *cstr)
 void *mrb_malloc(mrb_state*, size_t);
 void *mrb_calloc(mrb_state*, size_t, size_t);
 void *mrb_realloc(mrb_state*, void*, size_t);
+void *mrb_realloc_tt(mrb_state*, void*, size_t, enum mrb_vtype);
 struct RBasic *mrb_obj_alloc(mrb_state*, enum mrb_vtype, struct RClass*);
 void mrb_free(mrb_state*, void*);
 
@@ -253,7 +374,10 @@ mrb_value mrb_inspect(mrb_state *mrb, mrb_value obj);
 int mrb_eql(mrb_state *mrb, mrb_value obj1, mrb_value obj2);
 
 void mrb_garbage_collect(mrb_state*);
+void mrb_gc_freeze_old(mrb_state*);
 void mrb_incremental_gc(mrb_state *);
+typedef void (*mrb_gc_event_hook)(mrb_state *mrb, enum mrb_gc_event event, void *ud);
+void mrb_gc_set_event_hook(mrb_state *mrb, mrb_gc_event_hook hook, void *ud);
 int mrb_gc_arena_save(mrb_state*);
 void mrb_gc_arena_restore(mrb_state*,int);
 void mrb_gc_mark(mrb_state*,struct RBasic*);
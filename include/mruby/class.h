@@ -44,6 +44,12 @@ mrb_class(mrb_state *mrb, mrb_value v)
   }
 }
 
+/* mrb->bop_redefined: operators with VM fast paths redefined by user */
+#define MRB_BOP_FIXNUM 1
+#define MRB_BOP_STRING 2
+#define MRB_BOP_ARRAY  4
+#define MRB_BOP_HASH   8
+
 #define MRB_SET_INSTANCE_TT(c, tt) c->flags = ((c->flags & ~0xff) | (char)tt)
 #define MRB_INSTANCE_TT(c) (enum mrb_vtype)(c->flags & 0xff)
 
@@ -67,6 +73,9 @@ void mrb_obj_call_init(mrb_state *mrb, mrb_value obj, int argc, mrb_value *argv)
 void mrb_gc_mark_mt(mrb_state*, struct RClass*);
 size_t mrb_gc_mark_mt_size(mrb_state*, struct RClass*);
 void mrb_gc_free_mt(mrb_state*, struct RClass*);
+void mrb_gc_free_display(mrb_state*, struct RClass*);
+void mrb_free_class_displays(mrb_state*);
+mrb_bool mrb_class_inherit_p(mrb_state*, struct RClass*, struct RClass*);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
@@ -164,6 +164,20 @@ mrb_value mrb_load_file_cxt(mrb_state*,FILE*, mrbc_context *cxt);
 mrb_value mrb_load_string_cxt(mrb_state *mrb, const char *s, mrbc_context *cxt);
 mrb_value mrb_load_nstring_cxt(mrb_state *mrb, const char *s, int len, mrbc_context *cxt);
 
+/* compiled code cache of mrb_load_nstring() and friends (codecache.c);
+   sources seen before run without being parsed again.  Disabled until
+   a capacity is set, or MRB_CODE_CACHE_SIZE is defined. */
+struct mrb_code_cache_stat {
+  size_t capacity;              /* entries kept at most */
+  size_t entries;
+  size_t hits;
+  size_t misses;
+  size_t evictions;             /* least recently used entries dropped */
+};
+
+void mrb_code_cache_set_capacity(mrb_state *mrb, size_t capa);
+void mrb_code_cache_stat(mrb_state *mrb, struct mrb_code_cache_stat *stat);
+
 #if defined(__cplusplus)
 }  /* extern "C" { */
 #endif
@@ -13,17 +13,38 @@ extern "C" {
 
 #include "mruby.h"
 
+/* dump flags */
+#define DUMP_DEBUG_INFO 1
+#define DUMP_CRC32C     2   /* verify with CRC-32C instead of CRC-16 */
+
+int mrb_dump_irep(mrb_state *mrb, size_t start_index, int flags, uint8_t **bin, size_t *bin_size);
 #ifdef ENABLE_STDIO
 int mrb_dump_irep_binary(mrb_state*, size_t, int, FILE*);
 int mrb_dump_irep_cfunc(mrb_state *mrb, size_t n, int, FILE *f, const char *initname);
 int32_t mrb_read_irep_file(mrb_state*, FILE*);
 #endif
+/* an image whose iseq sections are aligned and in host byte order is
+   executed in place; it must stay mapped while the mrb_state lives */
 int32_t mrb_read_irep(mrb_state*, const uint8_t*);
+/* like mrb_read_irep, but each irep is decoded on its first call */
+int32_t mrb_read_irep_lazy(mrb_state*, const uint8_t*);
 
 #ifdef ENABLE_STDIO
 mrb_value mrb_load_irep_file(mrb_state*,FILE*);
 #endif
 
+/* archive of named RiteBinary modules (archive.c); archives stay open
+   until mrb_close() since loaded ireps point into them */
+typedef struct mrb_archive mrb_archive;
+
+int mrb_dump_archive(mrb_state *mrb, size_t n, const char *const *names, uint8_t *const *bins, const size_t *sizes, uint8_t **archive, size_t *archive_size);
+mrb_archive *mrb_archive_new(mrb_state *mrb, const uint8_t *bin, size_t size);
+#ifdef ENABLE_STDIO
+mrb_archive *mrb_archive_open(mrb_state *mrb, const char *path);
+#endif
+mrb_bool mrb_archive_include_p(mrb_state *mrb, mrb_archive *archive, const char *name);
+mrb_value mrb_archive_load(mrb_state *mrb, mrb_archive *archive, const char *name);
+
 /* dump/load error code
  *
  * NOTE: MRB_DUMP_GENERAL_FAILURE is caused by
@@ -40,10 +61,17 @@ mrb_value mrb_load_irep_file(mrb_state*,FILE*);
 
 /* null symbol length */
 #define MRB_DUMP_NULL_SYM_LEN         0xFFFF
+/* null symbol index */
+#define MRB_DUMP_NULL_SYM_INDEX       0xFFFFFFFF
 
 /* Rite Binary File header */
-#define RITE_BINARY_IDENTIFIER         "RITE"
-#define RITE_BINARY_FORMAT_VER         "0001"
+#define RITE_BINARY_IDENTIFIER         "RITE"  /* big-endian iseq */
+#define RITE_BINARY_IDENTIFIER_LIL     "ETIR"  /* little-endian iseq */
+#define RITE_BINARY_FORMAT_VER         "0005"
+#define RITE_BINARY_FORMAT_VER_0004    "0004"  /* a uint16 line number per instruction */
+#define RITE_BINARY_FORMAT_VER_0003    "0003"  /* symbol names inline in each irep */
+#define RITE_BINARY_FORMAT_VER_0002    "0002"  /* numeric pool entries as text */
+#define RITE_BINARY_FORMAT_VER_0001    "0001"  /* unpadded big-endian iseq */
 #define RITE_COMPILER_NAME             "MATZ"
 #define RITE_COMPILER_VERSION          "0000"
 
@@ -52,8 +80,24 @@ mrb_value mrb_load_irep_file(mrb_state*,FILE*);
 #define RITE_BINARY_EOF                "END\0"
 #define RITE_SECTION_IREP_IDENTIFIER   "IREP"
 #define RITE_SECTION_LINENO_IDENTIFIER "LINE"
+#define RITE_SECTION_SYMS_IDENTIFIER   "SYMS"
+#define RITE_SECTION_CRC32C_IDENTIFIER "CRCC"
+
+#define RITE_ARCHIVE_IDENTIFIER        "RARC"
+#define RITE_ARCHIVE_FORMAT_VER        "0001"
+#define MRB_ARCHIVE_ALIGNMENT          8
+
+/* pool entry types; before "0003" the mrb_vtype of the value was
+   written and numbers were stored as text */
+enum irep_pool_type {
+  IREP_TT_STRING = 0,   /* len(2) + bytes */
+  IREP_TT_INT32  = 1,   /* 4 bytes */
+  IREP_TT_INT64  = 2,   /* 8 bytes */
+  IREP_TT_FLOAT  = 3,   /* 8 bytes, IEEE-754 double */
+};
 
 #define MRB_DUMP_DEFAULT_STR_LEN      128
+#define MRB_DUMP_ALIGNMENT            sizeof(mrb_code)
 
 // binary header
 struct rite_binary_header {
@@ -89,10 +133,48 @@ struct rite_section_lineno_header {
   uint8_t sirep[2];           // Start index  
 };
 
+struct rite_section_syms_header {
+  RITE_SECTION_HEADER;
+
+  uint8_t nsyms[4];           // Number of symbols
+};
+
+/* first section when present; the header CRC is then unused */
+struct rite_section_crc32c_header {
+  RITE_SECTION_HEADER;
+
+  uint8_t crc[4];             // CRC-32C of the rest of the binary
+};
+
 struct rite_binary_footer {
   RITE_SECTION_HEADER;
 };
 
+// archive header; followed by nmodules entries sorted by name, the
+// names, and the modules, each at an MRB_ARCHIVE_ALIGNMENT offset
+struct rite_archive_header {
+  uint8_t archive_identify[4]; // Archive Identifier
+  uint8_t archive_version[4];  // Archive Format Version
+  uint8_t nmodules[4];         // Number of modules
+  uint8_t archive_size[4];     // Archive Size
+};
+
+struct rite_archive_entry {
+  uint8_t name_offset[4];      // offsets are from the archive start
+  uint8_t name_len[4];
+  uint8_t module_offset[4];
+  uint8_t module_size[4];
+};
+
+static inline int
+bigendian_p(void)
+{
+  int i = 1;
+  char *p = (char *)&i;
+
+  return p[0] ? 0 : 1;
+}
+
 static inline int
 uint8_to_bin(uint8_t s, uint8_t *bin)
 {
@@ -118,6 +200,14 @@ uint32_to_bin(uint32_t l, uint8_t *bin)
   return sizeof(uint32_t);
 }
 
+static inline int
+uint64_to_bin(uint64_t l, uint8_t *bin)
+{
+  uint32_to_bin((uint32_t)(l >> 32), bin);
+  uint32_to_bin((uint32_t)l, bin + sizeof(uint32_t));
+  return sizeof(uint64_t);
+}
+
 static inline uint32_t
 bin_to_uint32(const uint8_t *bin)
 {
@@ -127,6 +217,22 @@ bin_to_uint32(const uint8_t *bin)
          (uint32_t)bin[3];
 }
 
+static inline uint32_t
+bin_to_uint32_lil(const uint8_t *bin)
+{
+  return (uint32_t)bin[3] << 24 |
+         (uint32_t)bin[2] << 16 |
+         (uint32_t)bin[1] << 8  |
+         (uint32_t)bin[0];
+}
+
+static inline uint64_t
+bin_to_uint64(const uint8_t *bin)
+{
+  return (uint64_t)bin_to_uint32(bin) << 32 |
+         (uint64_t)bin_to_uint32(bin + sizeof(uint32_t));
+}
+
 static inline uint16_t
 bin_to_uint16(const uint8_t *bin)
 {
@@ -147,5 +253,7 @@ bin_to_uint8(const uint8_t *bin)
 /* crc.c */
 uint16_t
 calc_crc_16_ccitt(const uint8_t *src, size_t nbytes, uint16_t crc);
+uint32_t
+calc_crc_32c(const uint8_t *src, size_t nbytes, uint32_t crc);
 
 #endif  /* MRUBY_DUMP_H */
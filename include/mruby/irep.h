@@ -23,15 +23,57 @@ typedef struct mrb_irep {
 
   /* debug info */
   const char *filename;
-  uint16_t *lines;
+  const uint8_t *line_table;  /* pc->line runs, see mrb_irep_line() */
 
   size_t ilen, plen, slen;
+
+  /* undecoded record body of a lazily loaded irep */
+  const uint8_t *lazy_body;
+  struct rite_load_ctx *lazy_ctx;
+
+  /* compilation unit, see mrb_irep_seal(); refcnt and unit_len are
+     kept in the first irep of the unit only */
+  struct mrb_irep *unit;
+  uint32_t refcnt;
+  uint32_t unit_len;
 } mrb_irep;
 
-#define MRB_ISEQ_NO_FREE 1
+#define MRB_ISEQ_NO_FREE  1
+#define MRB_IREP_LAZY     2
+#define MRB_LINES_NO_FREE 4
 
 mrb_irep *mrb_add_irep(mrb_state *mrb);
+void mrb_irep_pool_barrier(mrb_state *mrb, mrb_irep *irep);
 mrb_value mrb_load_irep(mrb_state*, const uint8_t*);
+mrb_value mrb_load_irep_lazy(mrb_state*, const uint8_t*);
+void mrb_irep_decode(mrb_state *mrb, mrb_irep *irep);
+
+/* the ireps from start on become one unit, freed along with the last
+   proc referencing it; returns the (possibly moved) start index */
+size_t mrb_irep_seal(mrb_state *mrb, size_t start);
+void mrb_irep_decref(mrb_state *mrb, mrb_irep *irep);
+void mrb_irep_free(mrb_state *mrb, mrb_irep *irep);
+
+static inline void
+mrb_irep_incref(mrb_irep *irep)
+{
+  if (irep->unit) irep->unit->refcnt++;
+}
+
+/* line_table is a sequence of runs, each a LEB128 instruction count
+   followed by the zigzag LEB128 line delta from the previous run */
+uint8_t *mrb_irep_line_table(mrb_state *mrb, const uint16_t *lines, size_t n);
+size_t mrb_irep_line_table_size(const uint8_t *table, size_t ilen);
+int32_t mrb_irep_line(const mrb_irep *irep, size_t pc);
+
+/* decodes iseq, pool and syms of a lazily loaded irep before first use */
+static inline void
+mrb_irep_materialize(mrb_state *mrb, mrb_irep *irep)
+{
+  if (irep->flags & MRB_IREP_LAZY) {
+    mrb_irep_decode(mrb, irep);
+  }
+}
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
@@ -93,22 +93,28 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
    __hash_equal: hash comparation function
 */
 #define KHASH_DEFINE(name, khkey_t, khval_t, kh_is_map, __hash_func, __hash_equal) \
+  KHASH_DEFINE_TT(name, khkey_t, khval_t, kh_is_map, __hash_func, __hash_equal, MRB_TT_FALSE)
+
+/* same as KHASH_DEFINE, charging the table memory to objects of type
+   __tt (see mrb_realloc_tt) */
+#define KHASH_DEFINE_TT(name, khkey_t, khval_t, kh_is_map, __hash_func, __hash_equal, __tt) \
   void kh_alloc_##name(kh_##name##_t *h)                                \
   {                                                                     \
     khint_t sz = h->n_buckets;                                          \
     h->size = h->n_occupied = 0;                                        \
     h->upper_bound = UPPER_BOUND(sz);                                   \
-    h->e_flags = (uint8_t *)mrb_malloc(h->mrb, sizeof(uint8_t)*sz/4);   \
+    h->e_flags = (uint8_t *)mrb_realloc_tt(h->mrb, 0, sizeof(uint8_t)*sz/4, __tt);\
     h->d_flags = h->e_flags + sz/8;                                     \
     kh_fill_flags(h->e_flags, 0xff, sz/8);                              \
     kh_fill_flags(h->d_flags, 0x00, sz/8);                              \
-    h->keys = (khkey_t *)mrb_malloc(h->mrb, sizeof(khkey_t)*sz);        \
-    h->vals = (khval_t *)mrb_malloc(h->mrb, sizeof(khval_t)*sz);        \
+    h->keys = (khkey_t *)mrb_realloc_tt(h->mrb, 0, sizeof(khkey_t)*sz, __tt);\
+    h->vals = (khval_t *)mrb_realloc_tt(h->mrb, 0, sizeof(khval_t)*sz, __tt);\
     h->mask = sz-1;                                                     \
     h->inc = sz/2-1;                                                    \
   }                                                                     \
   kh_##name##_t *kh_init_##name##_size(mrb_state *mrb, khint_t size) {  \
-    kh_##name##_t *h = (kh_##name##_t*)mrb_calloc(mrb, 1, sizeof(kh_##name##_t)); \
+    kh_##name##_t *h = (kh_##name##_t*)mrb_realloc_tt(mrb, 0, sizeof(kh_##name##_t), __tt); \
+    memset(h, 0, sizeof(kh_##name##_t));                                \
     if (size < KHASH_MIN_SIZE)                                          \
       size = KHASH_MIN_SIZE;                                            \
     khash_power2(size);                                                 \
@@ -25,6 +25,7 @@ struct RProc {
   union {
     mrb_irep *irep;
     mrb_func_t func;
+    const struct mrb_argspec *spec;
   } body;
   struct RClass *target_class;
   struct REnv *env;
@@ -43,6 +44,14 @@ struct RProc {
 #define MRB_PROC_CFUNC_P(p) (((p)->flags & MRB_PROC_CFUNC) != 0)
 #define MRB_PROC_STRICT 256
 #define MRB_PROC_STRICT_P(p) (((p)->flags & MRB_PROC_STRICT) != 0)
+#define MRB_PROC_LEAF 512
+#define MRB_PROC_LEAF_P(p) (((p)->flags & MRB_PROC_LEAF) != 0)
+#define MRB_PROC_ARGSPEC 1024
+#define MRB_PROC_ARGSPEC_P(p) (((p)->flags & MRB_PROC_ARGSPEC) != 0)
+
+/* call a C function proc; callinfo must already be pushed */
+#define MRB_PROC_CFUNC_CALL(mrb,p,self) (MRB_PROC_ARGSPEC_P(p) ?\
+  mrb_argspec_call((mrb), (p)->body.spec, (self)) : (p)->body.func((mrb), (self)))
 
 #define mrb_proc_ptr(v)    ((struct RProc*)((v).value.p))
 
@@ -50,7 +59,7 @@ struct RProc *mrb_proc_new(mrb_state*, mrb_irep*);
 struct RProc *mrb_proc_new_cfunc(mrb_state*, mrb_func_t);
 struct RProc *mrb_closure_new(mrb_state*, mrb_irep*);
 struct RProc *mrb_closure_new_cfunc(mrb_state *mrb, mrb_func_t func, int nlocals);
-void mrb_proc_copy(struct RProc *a, struct RProc *b);
+void mrb_proc_copy(mrb_state *mrb, struct RProc *a, struct RProc *b);
 
 #include "mruby/khash.h"
 KHASH_DECLARE(mt, mrb_sym, struct RProc*, 1)
@@ -187,7 +187,7 @@ showcallinfo(mrb_state *mrb)
       mrb_irep *irep = ci->proc->body.irep;
       if (irep->filename != NULL)
         filename = irep->filename;
-      if (irep->lines != NULL) {
+      if (irep->line_table != NULL) {
         mrb_code *pc;
 
         if (i+1 <= ciidx) {
@@ -197,7 +197,7 @@ showcallinfo(mrb_state *mrb)
           pc = (mrb_code*)mrb_voidp(mrb_obj_iv_get(mrb, mrb->exc, mrb_intern(mrb, "lastpc")));
         }
         if (irep->iseq <= pc && pc < irep->iseq + irep->ilen) {
-          line = irep->lines[pc - irep->iseq - 1];
+          line = mrb_irep_line(irep, pc - irep->iseq - 1);
         }
       }
     }
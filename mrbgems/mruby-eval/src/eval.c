@@ -1,5 +1,6 @@
 #include "mruby.h"
 #include "mruby/compile.h"
+#include "mruby/hash.h"
 
 static mrb_value
 f_eval(mrb_state *mrb, mrb_value self)
@@ -11,10 +12,61 @@ f_eval(mrb_state *mrb, mrb_value self)
   return mrb_load_nstring(mrb, s, len);
 }
 
+#define cache_stat_set(mrb, h, name, v) \
+  mrb_hash_set((mrb), (h), mrb_symbol_value(mrb_intern_cstr((mrb), (name))), mrb_fixnum_value((mrb_int)(v)))
+
+/*
+ *  call-seq:
+ *     Kernel.eval_cache_stat   -> hash
+ *
+ *  Returns the capacity and the number of entries of the cache of
+ *  compiled eval sources, and its hit, miss and eviction counts.
+ *
+ *     Kernel.eval_cache_stat[:hits]   #=> 12
+ *
+ */
+static mrb_value
+f_eval_cache_stat(mrb_state *mrb, mrb_value self)
+{
+  struct mrb_code_cache_stat stat;
+  mrb_value h = mrb_hash_new(mrb);
+
+  mrb_code_cache_stat(mrb, &stat);
+  cache_stat_set(mrb, h, "capacity", stat.capacity);
+  cache_stat_set(mrb, h, "entries", stat.entries);
+  cache_stat_set(mrb, h, "hits", stat.hits);
+  cache_stat_set(mrb, h, "misses", stat.misses);
+  cache_stat_set(mrb, h, "evictions", stat.evictions);
+  return h;
+}
+
+/*
+ *  call-seq:
+ *     Kernel.eval_cache_capacity = n   -> n
+ *
+ *  Keeps the compiled code of at most n eval sources; 0 disables the
+ *  cache and drops every entry.
+ *
+ */
+static mrb_value
+f_eval_cache_capacity_set(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n;
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative capacity");
+  }
+  mrb_code_cache_set_capacity(mrb, (size_t)n);
+  return mrb_fixnum_value(n);
+}
+
 void
 mrb_mruby_eval_gem_init(mrb_state* mrb)
 {
   mrb_define_class_method(mrb, mrb->kernel_module, "eval", f_eval, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, mrb->kernel_module, "eval_cache_stat", f_eval_cache_stat, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, mrb->kernel_module, "eval_cache_capacity=", f_eval_cache_capacity_set, MRB_ARGS_REQ(1));
 }
 
 void
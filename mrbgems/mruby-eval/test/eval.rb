@@ -0,0 +1,59 @@
+##
+# Kernel.eval Test
+
+def eval_live_ireps
+  GC.start
+  GC.stat(:irep_slots) - GC.stat(:irep_free_slots)
+end
+
+assert('Kernel.eval') do
+  Kernel.eval("1 + 2") == 3 and Kernel.eval("[:a, 'b']") == [:a, 'b']
+end
+
+assert('Kernel.eval_cache_stat') do
+  Kernel.eval_cache_capacity = 0
+  Kernel.eval_cache_capacity = 2
+  s0 = Kernel.eval_cache_stat
+  Kernel.eval("1 + 1")
+  Kernel.eval("1 + 1")
+  Kernel.eval("2 + 2")
+  s1 = Kernel.eval_cache_stat
+  s1[:capacity] == 2 and s1[:entries] == 2 and
+    s1[:hits] - s0[:hits] == 1 and s1[:misses] - s0[:misses] == 2
+end
+
+assert('Kernel.eval cache evicts the least recently used code') do
+  Kernel.eval_cache_capacity = 0
+  Kernel.eval_cache_capacity = 2
+  s0 = Kernel.eval_cache_stat
+  Kernel.eval(":a")
+  Kernel.eval(":b")
+  Kernel.eval(":a")
+  Kernel.eval(":c")     # evicts :b
+  s1 = Kernel.eval_cache_stat
+  Kernel.eval(":a") == :a and Kernel.eval(":b") == :b and
+    s1[:evictions] - s0[:evictions] == 1 and s1[:entries] == 2 and
+    Kernel.eval_cache_stat[:hits] == s1[:hits] + 1 and
+    Kernel.eval_cache_stat[:misses] == s1[:misses] + 1
+end
+
+assert('Kernel.eval cache frees evicted code') do
+  Kernel.eval_cache_capacity = 0
+  Kernel.eval_cache_capacity = 1
+  Kernel.eval(":x0")
+  live = eval_live_ireps
+  evictions = Kernel.eval_cache_stat[:evictions]
+  # each source evicts the one before it
+  (1..10).each { |i| Kernel.eval(":x#{i}") }
+  eval_live_ireps == live and
+    Kernel.eval_cache_stat[:evictions] - evictions == 10
+end
+
+assert('Kernel.eval_cache_capacity=') do
+  Kernel.eval_cache_capacity = 3
+  Kernel.eval(":d")
+  Kernel.eval_cache_capacity = 0
+  Kernel.eval_cache_stat[:entries] == 0 and Kernel.eval(":d") == :d and
+    Kernel.eval_cache_stat[:entries] == 0 and
+    assert_raise(ArgumentError) { Kernel.eval_cache_capacity = -1 }
+end
@@ -24,7 +24,7 @@ mrb_proc_source_location(mrb_state *mrb, mrb_value self)
     mrb_value lines = mrb_nil_value();
 
     if (irep->filename) filename = mrb_str_new_cstr(mrb, irep->filename);
-    if (irep->lines)    lines = mrb_fixnum_value(*irep->lines);
+    if (irep->line_table) lines = mrb_fixnum_value(mrb_irep_line(irep, 0));
 
     return mrb_assoc_new(mrb, filename, lines);
   }
@@ -49,8 +49,8 @@ mrb_proc_inspect(mrb_state *mrb, mrb_value self)
     }
     mrb_str_cat_cstr(mrb, str, ":");
 
-    if (irep->lines) {
-      mrb_str_append(mrb, str, mrb_fixnum_value(*irep->lines));
+    if (irep->line_table) {
+      mrb_str_append(mrb, str, mrb_fixnum_value(mrb_irep_line(irep, 0)));
     }
     else {
       mrb_str_cat_cstr(mrb, str, "-");      
@@ -0,0 +1,339 @@
+/*
+** archive.c - mruby bytecode archive
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "mruby/dump.h"
+#include "mruby/irep.h"
+#include "mruby/proc.h"
+#include "mruby/string.h"
+
+#if defined(ENABLE_STDIO) && (defined(__unix__) || defined(__APPLE__))
+# define ARCHIVE_USE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#define ARCHIVE_IMAGE_STATIC  0  /* owned by the caller */
+#define ARCHIVE_IMAGE_MALLOC  1
+#define ARCHIVE_IMAGE_MMAP    2
+
+struct mrb_archive {
+  const uint8_t *image;
+  size_t size;
+  uint32_t nmodules;
+  const struct rite_archive_entry *entries;
+  int image_type;
+  struct mrb_archive *next;
+};
+
+struct archive_module {
+  const char *name;
+  size_t name_len;
+  const uint8_t *bin;
+  size_t size;
+};
+
+static size_t
+archive_padding(size_t offset)
+{
+  return (-offset) & (MRB_ARCHIVE_ALIGNMENT - 1);
+}
+
+static int
+name_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+  int c = memcmp(a, b, alen < blen ? alen : blen);
+
+  if (c != 0) return c;
+  return alen < blen ? -1 : alen > blen;
+}
+
+static int
+module_cmp(const void *a, const void *b)
+{
+  const struct archive_module *ma = (const struct archive_module *)a;
+  const struct archive_module *mb = (const struct archive_module *)b;
+
+  return name_cmp(ma->name, ma->name_len, mb->name, mb->name_len);
+}
+
+int
+mrb_dump_archive(mrb_state *mrb, size_t n, const char *const *names, uint8_t *const *bins, const size_t *sizes, uint8_t **archive, size_t *archive_size)
+{
+  struct archive_module *mods;
+  struct rite_archive_header *header;
+  uint8_t *cur, *entry;
+  size_t i, size, name_offset, module_offset;
+
+  *archive = NULL;
+  *archive_size = 0;
+  if (n > UINT32_MAX) {
+    return MRB_DUMP_INVALID_ARGUMENT;
+  }
+  mods = (struct archive_module *)mrb_malloc(mrb, sizeof(struct archive_module) * (n ? n : 1));
+  if (mods == NULL) {
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+
+  size = sizeof(struct rite_archive_header) + sizeof(struct rite_archive_entry) * n;
+  for (i = 0; i < n; i++) {
+    mods[i].name = names[i];
+    mods[i].name_len = strlen(names[i]);
+    mods[i].bin = bins[i];
+    mods[i].size = sizes[i];
+    size += mods[i].name_len;
+  }
+  qsort(mods, n, sizeof(struct archive_module), module_cmp);
+  for (i = 1; i < n; i++) {
+    if (module_cmp(&mods[i-1], &mods[i]) == 0) {
+      mrb_free(mrb, mods);
+      return MRB_DUMP_INVALID_ARGUMENT;
+    }
+  }
+  for (i = 0; i < n; i++) {
+    size += archive_padding(size) + mods[i].size;
+  }
+  if (size > UINT32_MAX) {
+    mrb_free(mrb, mods);
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+
+  cur = *archive = (uint8_t *)mrb_calloc(mrb, 1, size);
+  if (cur == NULL) {
+    mrb_free(mrb, mods);
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+  header = (struct rite_archive_header *)cur;
+  memcpy(header->archive_identify, RITE_ARCHIVE_IDENTIFIER, sizeof(header->archive_identify));
+  memcpy(header->archive_version, RITE_ARCHIVE_FORMAT_VER, sizeof(header->archive_version));
+  uint32_to_bin((uint32_t)n, header->nmodules);
+  uint32_to_bin((uint32_t)size, header->archive_size);
+
+  entry = cur + sizeof(struct rite_archive_header);
+  name_offset = sizeof(struct rite_archive_header) + sizeof(struct rite_archive_entry) * n;
+  module_offset = name_offset;
+  for (i = 0; i < n; i++) {
+    module_offset += mods[i].name_len;
+  }
+  for (i = 0; i < n; i++) {
+    module_offset += archive_padding(module_offset);
+    entry += uint32_to_bin((uint32_t)name_offset, entry);
+    entry += uint32_to_bin((uint32_t)mods[i].name_len, entry);
+    entry += uint32_to_bin((uint32_t)module_offset, entry);
+    entry += uint32_to_bin((uint32_t)mods[i].size, entry);
+    memcpy(cur + name_offset, mods[i].name, mods[i].name_len);
+    memcpy(cur + module_offset, mods[i].bin, mods[i].size);
+    name_offset += mods[i].name_len;
+    module_offset += mods[i].size;
+  }
+  *archive_size = size;
+
+  mrb_free(mrb, mods);
+  return MRB_DUMP_OK;
+}
+
+static int
+entry_name_cmp(const uint8_t *image, const struct rite_archive_entry *a, const struct rite_archive_entry *b)
+{
+  return name_cmp((const char *)image + bin_to_uint32(a->name_offset), bin_to_uint32(a->name_len),
+                  (const char *)image + bin_to_uint32(b->name_offset), bin_to_uint32(b->name_len));
+}
+
+/* checks that every entry lies within the image and that the names
+   are sorted, as archive_find() relies on */
+static mrb_archive*
+archive_new(mrb_state *mrb, const uint8_t *bin, size_t size, int image_type)
+{
+  const struct rite_archive_header *header = (const struct rite_archive_header *)bin;
+  const struct rite_archive_entry *entries;
+  mrb_archive *ar;
+  uint32_t nmodules, i;
+  size_t name_end, mod_end;
+
+  if (size < sizeof(struct rite_archive_header) ||
+      memcmp(header->archive_identify, RITE_ARCHIVE_IDENTIFIER, sizeof(header->archive_identify)) != 0 ||
+      memcmp(header->archive_version, RITE_ARCHIVE_FORMAT_VER, sizeof(header->archive_version)) != 0 ||
+      bin_to_uint32(header->archive_size) != size) {
+    return NULL;
+  }
+  nmodules = bin_to_uint32(header->nmodules);
+  if (nmodules > (size - sizeof(struct rite_archive_header)) / sizeof(struct rite_archive_entry)) {
+    return NULL;
+  }
+  entries = (const struct rite_archive_entry *)(bin + sizeof(struct rite_archive_header));
+  for (i = 0; i < nmodules; i++) {
+    name_end = (size_t)bin_to_uint32(entries[i].name_offset) + bin_to_uint32(entries[i].name_len);
+    mod_end = (size_t)bin_to_uint32(entries[i].module_offset) + bin_to_uint32(entries[i].module_size);
+    if (name_end > size || mod_end > size ||
+        bin_to_uint32(entries[i].module_size) < sizeof(struct rite_binary_header)) {
+      return NULL;
+    }
+    if (i > 0 && entry_name_cmp(bin, &entries[i-1], &entries[i]) >= 0) {
+      return NULL;
+    }
+  }
+
+  ar = (mrb_archive *)mrb_malloc(mrb, sizeof(mrb_archive));
+  if (ar == NULL) {
+    return NULL;
+  }
+  ar->image = bin;
+  ar->size = size;
+  ar->nmodules = nmodules;
+  ar->entries = entries;
+  ar->image_type = image_type;
+  ar->next = mrb->archives;
+  mrb->archives = ar;
+  return ar;
+}
+
+/* bin must stay valid until mrb_close() */
+mrb_archive*
+mrb_archive_new(mrb_state *mrb, const uint8_t *bin, size_t size)
+{
+  return archive_new(mrb, bin, size, ARCHIVE_IMAGE_STATIC);
+}
+
+#ifdef ENABLE_STDIO
+mrb_archive*
+mrb_archive_open(mrb_state *mrb, const char *path)
+{
+  mrb_archive *ar;
+#ifdef ARCHIVE_USE_MMAP
+  int fd;
+  struct stat st;
+  void *map;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  ar = archive_new(mrb, (const uint8_t *)map, (size_t)st.st_size, ARCHIVE_IMAGE_MMAP);
+  if (ar == NULL) {
+    munmap(map, (size_t)st.st_size);
+  }
+#else
+  FILE *fp;
+  long size;
+  uint8_t *buf;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0 ||
+      fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  buf = (uint8_t *)mrb_malloc(mrb, (size_t)size);
+  if (buf == NULL || fread(buf, (size_t)size, 1, fp) == 0) {
+    fclose(fp);
+    mrb_free(mrb, buf);
+    return NULL;
+  }
+  fclose(fp);
+  ar = archive_new(mrb, buf, (size_t)size, ARCHIVE_IMAGE_MALLOC);
+  if (ar == NULL) {
+    mrb_free(mrb, buf);
+  }
+#endif
+  return ar;
+}
+#endif /* ENABLE_STDIO */
+
+static const struct rite_archive_entry*
+archive_find(mrb_archive *ar, const char *name)
+{
+  size_t len = strlen(name);
+  uint32_t lo = 0, hi = ar->nmodules, mid;
+  const struct rite_archive_entry *e;
+  int c;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    e = &ar->entries[mid];
+    c = name_cmp(name, len, (const char *)ar->image + bin_to_uint32(e->name_offset),
+                 bin_to_uint32(e->name_len));
+    if (c == 0) return e;
+    if (c < 0) hi = mid;
+    else lo = mid + 1;
+  }
+  return NULL;
+}
+
+mrb_bool
+mrb_archive_include_p(mrb_state *mrb, mrb_archive *ar, const char *name)
+{
+  return archive_find(ar, name) != NULL;
+}
+
+/* ireps are decoded lazily, straight out of the archive image */
+mrb_value
+mrb_archive_load(mrb_state *mrb, mrb_archive *ar, const char *name)
+{
+  const struct rite_archive_entry *e = archive_find(ar, name);
+  const uint8_t *bin;
+  int32_t n;
+  mrb_value mesg;
+
+  if (e == NULL) {
+    mesg = mrb_str_new_cstr(mrb, "no such module in archive -- ");
+    mrb_str_cat_cstr(mrb, mesg, name);
+    mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SCRIPT_ERROR, RSTRING_PTR(mesg), RSTRING_LEN(mesg)));
+    return mrb_nil_value();
+  }
+  bin = ar->image + bin_to_uint32(e->module_offset);
+  if (bin_to_uint32(((const struct rite_binary_header *)bin)->binary_size) > bin_to_uint32(e->module_size)) {
+    n = MRB_DUMP_INVALID_FILE_HEADER;
+  }
+  else {
+    n = mrb_read_irep_lazy(mrb, bin);
+  }
+  if (n < 0) {
+    static const char msg[] = "irep load error";
+    mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SCRIPT_ERROR, msg, sizeof(msg) - 1));
+    return mrb_nil_value();
+  }
+  return mrb_run(mrb, mrb_proc_new(mrb, mrb->irep[n]), mrb_top_self(mrb));
+}
+
+void
+mrb_free_archives(mrb_state *mrb)
+{
+  mrb_archive *ar = mrb->archives, *next;
+
+  while (ar) {
+    next = ar->next;
+    switch (ar->image_type) {
+#ifdef ARCHIVE_USE_MMAP
+    case ARCHIVE_IMAGE_MMAP:
+      munmap((void *)ar->image, ar->size);
+      break;
+#endif
+    case ARCHIVE_IMAGE_MALLOC:
+      mrb_free(mrb, (void *)ar->image);
+      break;
+    default:
+      break;
+    }
+    mrb_free(mrb, ar);
+    ar = next;
+  }
+  mrb->archives = NULL;
+}
@@ -46,7 +46,7 @@ ary_new_capa(mrb_state *mrb, mrb_int capa)
   }
 
   a = (struct RArray*)mrb_obj_alloc(mrb, MRB_TT_ARRAY, mrb->array_class);
-  a->ptr = (mrb_value *)mrb_malloc(mrb, blen);
+  a->ptr = (mrb_value *)mrb_realloc_tt(mrb, 0, blen, MRB_TT_ARRAY);
   a->aux.capa = capa;
   a->len = 0;
 
@@ -126,7 +126,7 @@ ary_modify(mrb_state *mrb, struct RArray *a)
 
       p = a->ptr;
       len = a->len * sizeof(mrb_value);
-      ptr = (mrb_value *)mrb_malloc(mrb, len);
+      ptr = (mrb_value *)mrb_realloc_tt(mrb, 0, len, MRB_TT_ARRAY);
       if (p) {
         array_copy(ptr, p, a->len);
       }
@@ -146,7 +146,7 @@ ary_make_shared(mrb_state *mrb, struct RArray *a)
 
     shared->refcnt = 1;
     if (a->aux.capa > a->len) {
-      a->ptr = shared->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*a->len+1);
+      a->ptr = shared->ptr = (mrb_value *)mrb_realloc_tt(mrb, a->ptr, sizeof(mrb_value)*a->len+1, MRB_TT_ARRAY);
     }
     else {
       shared->ptr = a->ptr;
@@ -178,7 +178,7 @@ ary_expand_capa(mrb_state *mrb, struct RArray *a, mrb_int len)
   if (capa > ARY_MAX_SIZE) capa = ARY_MAX_SIZE; /* len <= capa <= ARY_MAX_SIZE */
 
   if (capa > a->aux.capa) {
-    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc_tt(mrb, a->ptr, sizeof(mrb_value)*capa, MRB_TT_ARRAY);
 
     if (!expanded_ptr) {
       mrb_raise(mrb, E_RUNTIME_ERROR, "out of memory");
@@ -207,7 +207,7 @@ ary_shrink_capa(mrb_state *mrb, struct RArray *a)
 
   if (capa > a->len && capa < a->aux.capa) {
     a->aux.capa = capa;
-    a->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+    a->ptr = (mrb_value *)mrb_realloc_tt(mrb, a->ptr, sizeof(mrb_value)*capa, MRB_TT_ARRAY);
   }
 }
 
@@ -444,13 +444,12 @@ mrb_ary_push(mrb_state *mrb, mrb_value ary, mrb_value elem) /* mrb_ary_push */
   mrb_write_barrier(mrb, (struct RBasic*)a);
 }
 
-mrb_value
-mrb_ary_push_m(mrb_state *mrb, mrb_value self)
+static mrb_value
+mrb_ary_push_m(mrb_state *mrb, mrb_value self, mrb_arg *args, int argc)
 {
-  mrb_value *argv;
-  int len;
+  mrb_value *argv = args[0].a.ptr;
+  mrb_int len = args[0].a.len;
 
-  mrb_get_args(mrb, "*", &argv, &len);
   while (len--) {
     mrb_ary_push(mrb, self, *argv++);
   }
@@ -458,6 +457,8 @@ mrb_ary_push_m(mrb_state *mrb, mrb_value self)
   return self;
 }
 
+static const mrb_argspec ary_push_spec = MRB_ARGSPEC(mrb_ary_push_m, 0, 0, 1, 0, NULL);
+
 mrb_value
 mrb_ary_pop(mrb_state *mrb, mrb_value ary)
 {
@@ -1143,27 +1144,27 @@ mrb_init_array(mrb_state *mrb)
 
   mrb_define_method(mrb, a, "*",               mrb_ary_times,        MRB_ARGS_REQ(1)); /* 15.2.12.5.1  */
   mrb_define_method(mrb, a, "+",               mrb_ary_plus,         MRB_ARGS_REQ(1)); /* 15.2.12.5.2  */
-  mrb_define_method(mrb, a, "<<",              mrb_ary_push_m,       MRB_ARGS_REQ(1)); /* 15.2.12.5.3  */
+  mrb_define_method_spec(mrb, a, "<<",         &ary_push_spec);                    /* 15.2.12.5.3  */
   mrb_define_method(mrb, a, "[]",              mrb_ary_aget,         MRB_ARGS_ANY());  /* 15.2.12.5.4  */
   mrb_define_method(mrb, a, "[]=",             mrb_ary_aset,         MRB_ARGS_ANY());  /* 15.2.12.5.5  */
   mrb_define_method(mrb, a, "clear",           mrb_ary_clear,        MRB_ARGS_NONE()); /* 15.2.12.5.6  */
   mrb_define_method(mrb, a, "concat",          mrb_ary_concat_m,     MRB_ARGS_REQ(1)); /* 15.2.12.5.8  */
   mrb_define_method(mrb, a, "delete_at",       mrb_ary_delete_at,    MRB_ARGS_REQ(1)); /* 15.2.12.5.9  */
-  mrb_define_method(mrb, a, "empty?",          mrb_ary_empty_p,      MRB_ARGS_NONE()); /* 15.2.12.5.12 */
+  mrb_define_leaf_method(mrb, a, "empty?",          mrb_ary_empty_p);                  /* 15.2.12.5.12 */
   mrb_define_method(mrb, a, "first",           mrb_ary_first,        MRB_ARGS_OPT(1)); /* 15.2.12.5.13 */
   mrb_define_method(mrb, a, "index",           mrb_ary_index_m,      MRB_ARGS_REQ(1)); /* 15.2.12.5.14 */
   mrb_define_method(mrb, a, "initialize_copy", mrb_ary_replace_m,    MRB_ARGS_REQ(1)); /* 15.2.12.5.16 */
   mrb_define_method(mrb, a, "join",            mrb_ary_join_m,       MRB_ARGS_ANY());  /* 15.2.12.5.17 */
   mrb_define_method(mrb, a, "last",            mrb_ary_last,         MRB_ARGS_ANY());  /* 15.2.12.5.18 */
-  mrb_define_method(mrb, a, "length",          mrb_ary_size,         MRB_ARGS_NONE()); /* 15.2.12.5.19 */
+  mrb_define_leaf_method(mrb, a, "length",          mrb_ary_size);                     /* 15.2.12.5.19 */
   mrb_define_method(mrb, a, "pop",             mrb_ary_pop,          MRB_ARGS_NONE()); /* 15.2.12.5.21 */
-  mrb_define_method(mrb, a, "push",            mrb_ary_push_m,       MRB_ARGS_ANY());  /* 15.2.12.5.22 */
+  mrb_define_method_spec(mrb, a, "push",       &ary_push_spec);                    /* 15.2.12.5.22 */
   mrb_define_method(mrb, a, "replace",         mrb_ary_replace_m,    MRB_ARGS_REQ(1)); /* 15.2.12.5.23 */
   mrb_define_method(mrb, a, "reverse",         mrb_ary_reverse,      MRB_ARGS_NONE()); /* 15.2.12.5.24 */
   mrb_define_method(mrb, a, "reverse!",        mrb_ary_reverse_bang, MRB_ARGS_NONE()); /* 15.2.12.5.25 */
   mrb_define_method(mrb, a, "rindex",          mrb_ary_rindex_m,     MRB_ARGS_REQ(1)); /* 15.2.12.5.26 */
   mrb_define_method(mrb, a, "shift",           mrb_ary_shift,        MRB_ARGS_NONE()); /* 15.2.12.5.27 */
-  mrb_define_method(mrb, a, "size",            mrb_ary_size,         MRB_ARGS_NONE()); /* 15.2.12.5.28 */
+  mrb_define_leaf_method(mrb, a, "size",            mrb_ary_size);                     /* 15.2.12.5.28 */
   mrb_define_method(mrb, a, "slice",           mrb_ary_aget,         MRB_ARGS_ANY());  /* 15.2.12.5.29 */
   mrb_define_method(mrb, a, "unshift",         mrb_ary_unshift_m,    MRB_ARGS_ANY());  /* 15.2.12.5.30 */
 
@@ -49,6 +49,111 @@ mrb_gc_free_mt(mrb_state *mrb, struct RClass *c)
   kh_destroy(mt, c->mt);
 }
 
+/*
+  Cohen display: the non-iclass ancestors of a class, root first.
+  Superclasses of classes never change after creation (include only
+  inserts iclasses), so a display stays valid for the class lifetime.
+  Displays are indexed by a serial kept in the flag bits above the
+  instance type; serial 0 means none assigned yet.
+ */
+struct mrb_class_display {
+  struct RClass **display;
+  int len;                      /* next free serial while unused */
+};
+
+#define CLASS_SERIAL_SHIFT 8
+#define CLASS_SERIAL_MAX 0x1fff
+#define CLASS_SERIAL(c) ((c)->flags >> CLASS_SERIAL_SHIFT)
+
+static struct mrb_class_display*
+class_display(mrb_state *mrb, struct RClass *c)
+{
+  struct mrb_class_display *d;
+  struct RClass **display;
+  struct RClass *s;
+  int serial = CLASS_SERIAL(c);
+  int len = 0;
+
+  if (serial) return &mrb->class_displays[serial];
+  if (!mrb->class_displays_free && mrb->class_displays_len > CLASS_SERIAL_MAX) {
+    return NULL;
+  }
+
+  for (s = c; s; s = s->super) {
+    if (s->tt != MRB_TT_ICLASS) len++;
+  }
+  display = (struct RClass**)mrb_malloc(mrb, sizeof(struct RClass*)*len);
+  d = NULL;
+  if (mrb->class_displays_free) {
+    serial = mrb->class_displays_free;
+    d = &mrb->class_displays[serial];
+    mrb->class_displays_free = d->len;
+  }
+  else {
+    if (mrb->class_displays_len == 0) {
+      mrb->class_displays_len = 1;   /* serial 0 is reserved */
+    }
+    if (mrb->class_displays_len >= mrb->class_displays_capa) {
+      int capa = mrb->class_displays_capa ? mrb->class_displays_capa * 2 : 64;
+
+      mrb->class_displays = (struct mrb_class_display*)
+        mrb_realloc(mrb, mrb->class_displays, sizeof(struct mrb_class_display)*capa);
+      mrb->class_displays_capa = capa;
+    }
+    serial = mrb->class_displays_len++;
+    d = &mrb->class_displays[serial];
+  }
+  d->display = display;
+  d->len = len;
+  for (s = c; s; s = s->super) {
+    if (s->tt != MRB_TT_ICLASS) display[--len] = s;
+  }
+  c->flags |= serial << CLASS_SERIAL_SHIFT;
+  return d;
+}
+
+void
+mrb_gc_free_display(mrb_state *mrb, struct RClass *c)
+{
+  struct mrb_class_display *d;
+  int serial = CLASS_SERIAL(c);
+
+  if (!serial) return;
+  d = &mrb->class_displays[serial];
+  mrb_free(mrb, d->display);
+  d->display = NULL;
+  d->len = mrb->class_displays_free;
+  mrb->class_displays_free = serial;
+}
+
+void
+mrb_free_class_displays(mrb_state *mrb)
+{
+  mrb_free(mrb, mrb->class_displays);
+}
+
+/* TRUE if class c is cl or one of its superclasses (not for modules) */
+mrb_bool
+mrb_class_inherit_p(mrb_state *mrb, struct RClass *cl, struct RClass *c)
+{
+  struct mrb_class_display *d;
+  int depth;
+
+  d = class_display(mrb, c);
+  if (d) {
+    depth = d->len;
+    d = class_display(mrb, cl);
+    if (d) {
+      return depth <= d->len && d->display[depth-1] == c;
+    }
+  }
+  while (cl) {
+    if (cl == c) return TRUE;
+    cl = cl->super;
+  }
+  return FALSE;
+}
+
 void
 mrb_name_class(mrb_state *mrb, struct RClass *c, mrb_sym name)
 {
@@ -285,12 +390,56 @@ mrb_define_module_under(mrb_state *mrb, struct RClass *outer, const char *name)
   return c;
 }
 
+static int
+bop_name_p(mrb_state *mrb, mrb_sym mid, const char **names)
+{
+  while (*names) {
+    if (mid == mrb_intern_cstr(mrb, *names)) return TRUE;
+    names++;
+  }
+  return FALSE;
+}
+
+/* operators the VM computes inline must not be taken over by user code */
+static void
+bop_check_redefined(mrb_state *mrb, struct RClass *c, mrb_sym mid)
+{
+  static const char *fixnum_ops[] = { "%", "<<", ">>", "&", "|", "^", "-@", NULL };
+  static const char *index_ops[] = { "[]", "[]=", NULL };
+  int flag;
+  const char **names;
+
+  if (c == mrb->fixnum_class) {
+    flag = MRB_BOP_FIXNUM;
+    names = fixnum_ops;
+  }
+  else if (c == mrb->array_class) {
+    flag = MRB_BOP_ARRAY;
+    names = index_ops;
+  }
+  else if (c == mrb->hash_class) {
+    flag = MRB_BOP_HASH;
+    names = index_ops;
+  }
+  else if (c == mrb->string_class) {
+    flag = MRB_BOP_STRING;
+    names = index_ops;
+  }
+  else {
+    return;
+  }
+  if ((mrb->bop_redefined & flag) == 0 && bop_name_p(mrb, mid, names)) {
+    mrb->bop_redefined |= flag;
+  }
+}
+
 void
 mrb_define_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, struct RProc *p)
 {
   khash_t(mt) *h = c->mt;
   khiter_t k;
 
+  bop_check_redefined(mrb, c, mid);
   if (!h) h = c->mt = kh_init(mt, mrb);
   k = kh_put(mt, h, mid);
   kh_value(h, k) = p;
@@ -317,6 +466,24 @@ mrb_define_method(mrb_state *mrb, struct RClass *c, const char *name, mrb_func_t
   mrb_define_method_id(mrb, c, mrb_intern(mrb, name), func, aspec);
 }
 
+/*
+  defines a method the VM may call without pushing a callinfo frame.
+  func receives only self; it must not take arguments (mrb_get_args),
+  raise, yield or call back into Ruby.
+ */
+void
+mrb_define_leaf_method(mrb_state *mrb, struct RClass *c, const char *name, mrb_func_t func)
+{
+  struct RProc *p;
+  int ai = mrb_gc_arena_save(mrb);
+
+  p = mrb_proc_new_cfunc(mrb, func);
+  p->flags |= MRB_PROC_LEAF;
+  p->target_class = c;
+  mrb_define_method_raw(mrb, c, mrb_intern(mrb, name), p);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
 void
 mrb_define_method_vm(mrb_state *mrb, struct RClass *c, mrb_sym name, mrb_value body)
 {
@@ -324,6 +491,7 @@ mrb_define_method_vm(mrb_state *mrb, struct RClass *c, mrb_sym name, mrb_value b
   khiter_t k;
   struct RProc *p;
 
+  bop_check_redefined(mrb, c, name);
   if (!h) h = c->mt = kh_init(mt, mrb);
   k = kh_put(mt, h, name);
   p = mrb_proc_ptr(body);
@@ -363,6 +531,73 @@ to_hash(mrb_state *mrb, mrb_value val)
   return check_type(mrb, val, MRB_TT_HASH, "Hash", "to_hash");
 }
 
+static mrb_value
+to_cstr(mrb_state *mrb, mrb_value val)
+{
+  struct RString *s;
+
+  val = to_str(mrb, val);
+  s = mrb_str_ptr(val);
+  if (strlen(s->ptr) != s->len) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "String contains NUL");
+  }
+  return val;
+}
+
+static mrb_float
+to_float(mrb_state *mrb, mrb_value val)
+{
+  switch (mrb_type(val)) {
+    case MRB_TT_FLOAT:
+      return mrb_float(val);
+    case MRB_TT_FIXNUM:
+      return (mrb_float)mrb_fixnum(val);
+    case MRB_TT_STRING:
+      mrb_raise(mrb, E_TYPE_ERROR, "String can't be coerced into Float");
+      return 0.0;
+    default:
+      return mrb_float(mrb_convert_type(mrb, val, MRB_TT_FLOAT, "Float", "to_f"));
+  }
+}
+
+static mrb_int
+to_int(mrb_state *mrb, mrb_value val)
+{
+  switch (mrb_type(val)) {
+    case MRB_TT_FIXNUM:
+      return mrb_fixnum(val);
+    case MRB_TT_FLOAT:
+      {
+        mrb_float f = mrb_float(val);
+
+        if (!FIXABLE(f)) {
+          mrb_raise(mrb, E_RANGE_ERROR, "float too big for int");
+        }
+        return (mrb_int)f;
+      }
+    case MRB_TT_FALSE:
+      return 0;
+    default:
+      return mrb_fixnum(mrb_convert_type(mrb, val, MRB_TT_FIXNUM, "Integer", "to_int"));
+  }
+}
+
+static mrb_sym
+to_sym(mrb_state *mrb, mrb_value val)
+{
+  if (mrb_type(val) == MRB_TT_SYMBOL) {
+    return mrb_symbol(val);
+  }
+  else if (mrb_string_p(val)) {
+    return mrb_intern_str(mrb, to_str(mrb, val));
+  }
+  else {
+    mrb_value obj = mrb_funcall(mrb, val, "inspect", 0);
+    mrb_raisef(mrb, E_TYPE_ERROR, "%S is not a symbol", obj);
+    return 0;
+  }
+}
+
 /*
   retrieve arguments from mrb_state.
 
@@ -486,11 +721,8 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         ps = va_arg(ap, char**);
         if (i < argc) {
-          ss = to_str(mrb, *sp++);
+          ss = to_cstr(mrb, *sp++);
           s = mrb_str_ptr(ss);
-          if (strlen(s->ptr) != s->len) {
-            mrb_raise(mrb, E_ARGUMENT_ERROR, "String contains NUL");
-          }
           *ps = s->ptr;
           i++;
         }
@@ -520,26 +752,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         p = va_arg(ap, mrb_float*);
         if (i < argc) {
-          switch (mrb_type(*sp)) {
-            case MRB_TT_FLOAT:
-              *p = mrb_float(*sp);
-              break;
-            case MRB_TT_FIXNUM:
-              *p = (mrb_float)mrb_fixnum(*sp);
-              break;
-            case MRB_TT_STRING:
-              mrb_raise(mrb, E_TYPE_ERROR, "String can't be coerced into Float");
-              break;
-            default:
-              {
-                mrb_value tmp;
-
-                tmp = mrb_convert_type(mrb, *sp, MRB_TT_FLOAT, "Float", "to_f");
-                *p = mrb_float(tmp);
-              }
-              break;
-          }
-          sp++;
+          *p = to_float(mrb, *sp++);
           i++;
         }
       }
@@ -550,33 +763,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         p = va_arg(ap, mrb_int*);
         if (i < argc) {
-          switch (mrb_type(*sp)) {
-            case MRB_TT_FIXNUM:
-              *p = mrb_fixnum(*sp);
-              break;
-            case MRB_TT_FLOAT:
-              {
-                mrb_float f = mrb_float(*sp);
-
-                if (!FIXABLE(f)) {
-                  mrb_raise(mrb, E_RANGE_ERROR, "float too big for int");
-                }
-                *p = (mrb_int)f;
-              }
-              break;
-            case MRB_TT_FALSE:
-              *p = 0;
-              break;
-            default:
-              {
-                mrb_value tmp;
-
-                tmp = mrb_convert_type(mrb, *sp, MRB_TT_FIXNUM, "Integer", "to_int");
-                *p = mrb_fixnum(tmp);
-              }
-              break;
-          }
-          sp++;
+          *p = to_int(mrb, *sp++);
           i++;
         }
       }
@@ -598,19 +785,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         symp = va_arg(ap, mrb_sym*);
         if (i < argc) {
-          mrb_value ss;
-
-          ss = *sp++;
-          if (mrb_type(ss) == MRB_TT_SYMBOL) {
-            *symp = mrb_symbol(ss);
-          }
-          else if (mrb_string_p(ss)) {
-            *symp = mrb_intern_str(mrb, to_str(mrb, ss));
-          }
-          else {
-            mrb_value obj = mrb_funcall(mrb, ss, "inspect", 0);
-            mrb_raisef(mrb, E_TYPE_ERROR, "%S is not a symbol", obj);
-          }
+          *symp = to_sym(mrb, *sp++);
           i++;
         }
       }
@@ -668,6 +843,153 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
   return i;
 }
 
+void
+mrb_argconv_str(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->v = to_str(mrb, v);
+}
+
+void
+mrb_argconv_ary(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->v = to_ary(mrb, v);
+}
+
+void
+mrb_argconv_hash(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->v = to_hash(mrb, v);
+}
+
+void
+mrb_argconv_strptr(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  struct RString *s = mrb_str_ptr(to_str(mrb, v));
+
+  arg->s.ptr = s->ptr;
+  arg->s.len = s->len;
+}
+
+void
+mrb_argconv_cstr(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  struct RString *s = mrb_str_ptr(to_cstr(mrb, v));
+
+  arg->s.ptr = s->ptr;
+  arg->s.len = s->len;
+}
+
+void
+mrb_argconv_aryptr(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  struct RArray *a = mrb_ary_ptr(to_ary(mrb, v));
+
+  arg->a.ptr = a->ptr;
+  arg->a.len = a->len;
+}
+
+void
+mrb_argconv_float(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->f = to_float(mrb, v);
+}
+
+void
+mrb_argconv_int(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->i = to_int(mrb, v);
+}
+
+void
+mrb_argconv_bool(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->b = mrb_test(v);
+}
+
+void
+mrb_argconv_sym(mrb_state *mrb, mrb_value v, mrb_arg *arg)
+{
+  arg->n = to_sym(mrb, v);
+}
+
+/*
+  retrieve arguments according to an argspec.
+
+  fills the req + opt slots, then the rest and block slots if the
+  spec has them; optional slots without a corresponding argument are
+  left untouched.  returns number of arguments parsed, like
+  mrb_get_args().
+ */
+int
+mrb_get_args_spec(mrb_state *mrb, const mrb_argspec *spec, mrb_arg *argv)
+{
+  mrb_value *sp = mrb->stack + 1;
+  int argc = mrb->ci->argc;
+  int npos = spec->req + spec->opt;
+  int n, i;
+
+  if (argc < 0) {
+    struct RArray *a = mrb_ary_ptr(mrb->stack[1]);
+
+    argc = a->len;
+    sp = a->ptr;
+  }
+  if (argc < spec->req || (argc > npos && !spec->rest)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments");
+  }
+  n = argc < npos ? argc : npos;
+  for (i = 0; i < n; i++) {
+    if (spec->conv[i]) {
+      spec->conv[i](mrb, sp[i], &argv[i]);
+    }
+    else {
+      argv[i].v = sp[i];
+    }
+  }
+  argv += npos;
+  if (spec->rest) {
+    argv->a.len = argc - n;
+    argv->a.ptr = argv->a.len > 0 ? sp + n : NULL;
+    argv++;
+    n = argc;
+  }
+  if (spec->block) {
+    argv->v = mrb->stack[mrb->ci->argc < 0 ? 2 : mrb->ci->argc + 1];
+  }
+  return n;
+}
+
+mrb_value
+mrb_argspec_call(mrb_state *mrb, const mrb_argspec *spec, mrb_value self)
+{
+  mrb_arg argv[MRB_ARGSPEC_MAX];
+  int argc;
+
+  argc = mrb_get_args_spec(mrb, spec, argv);
+  return spec->func(mrb, self, argv, argc);
+}
+
+/*
+  defines a method that takes its arguments according to spec; the VM
+  converts them before calling spec->func.
+ */
+void
+mrb_define_method_spec(mrb_state *mrb, struct RClass *c, const char *name, const mrb_argspec *spec)
+{
+  struct RProc *p;
+  int ai = mrb_gc_arena_save(mrb);
+
+  if (spec->req + spec->opt + (spec->rest != 0) + (spec->block != 0) > MRB_ARGSPEC_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "too many argument specifiers");
+  }
+  p = mrb_proc_new_cfunc(mrb, NULL);
+  p->body.spec = spec;
+  p->flags |= MRB_PROC_ARGSPEC;
+  p->target_class = c;
+  mrb_define_method_raw(mrb, c, mrb_intern(mrb, name), p);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
 static struct RClass*
 boot_defclass(mrb_state *mrb, struct RClass *super)
 {
@@ -1466,7 +1788,7 @@ mod_define_method(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given");
   }
   p = (struct RProc*)mrb_obj_alloc(mrb, MRB_TT_PROC, mrb->proc_class);
-  mrb_proc_copy(p, mrb_proc_ptr(blk));
+  mrb_proc_copy(mrb, p, mrb_proc_ptr(blk));
   mrb_define_method_raw(mrb, c, mid, p);
   return blk;
 }
@@ -1708,6 +2030,7 @@ remove_method(mrb_state *mrb, mrb_value mod, mrb_sym mid)
   if (h) {
     k = kh_get(mt, h, mid);
     if (k != kh_end(h)) {
+      bop_check_redefined(mrb, c, mid);
       kh_del(mt, h, k);
       return;
     }
@@ -0,0 +1,308 @@
+/*
+** codecache.c - compiled code cache for mrb_load_nstring
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include "mruby.h"
+#include "mruby/compile.h"
+#include "mruby/irep.h"
+
+/*
+  Entries map a source string and the mrbc_context it is compiled
+  with (filename, lineno and the local variables passed in) to the
+  top-level irep of the compiled unit.  Each entry holds a reference
+  to the unit, so cached code outlives the procs made from it until
+  the entry is evicted.  The list is kept in LRU order, most recently
+  used first.
+ */
+struct code_cache_entry {
+  struct code_cache_entry *hnext;   /* bucket chain */
+  struct code_cache_entry *prev, *next;  /* LRU list */
+  uint32_t hash;
+  char *src;
+  size_t len;
+  char *filename;
+  short lineno;
+  mrb_sym *syms;                    /* locals passed in */
+  int slen;
+  mrb_sym *out_syms;                /* locals after the parse */
+  int out_slen;
+  mrb_irep *irep;
+};
+
+struct mrb_code_cache {
+  struct code_cache_entry **buckets;
+  size_t nbuckets;
+  struct code_cache_entry *head, *tail;
+  size_t len;
+  size_t capa;
+  size_t hits, misses, evictions;
+};
+
+static uint32_t
+hash_bytes(uint32_t h, const void *p, size_t len)
+{
+  const uint8_t *s = (const uint8_t *)p;
+
+  while (len--) {
+    h = (h ^ *s++) * 16777619u;
+  }
+  return h;
+}
+
+/* what the compiled code depends on; a NULL context has lineno -1 */
+struct code_cache_key {
+  const char *src;
+  size_t len;
+  const char *filename;
+  short lineno;
+  const mrb_sym *syms;
+  int slen;
+  uint32_t hash;
+};
+
+static void
+code_cache_key_init(struct code_cache_key *key, const char *s, size_t len, mrbc_context *c, const mrb_sym *syms, int slen)
+{
+  uint32_t h;
+
+  key->src = s;
+  key->len = len;
+  key->filename = c ? c->filename : NULL;
+  key->lineno = c ? c->lineno : -1;
+  key->syms = syms;
+  key->slen = slen;
+
+  h = hash_bytes(2166136261u, s, len);
+  if (key->filename) h = hash_bytes(h, key->filename, strlen(key->filename) + 1);
+  h = hash_bytes(h, &key->lineno, sizeof(key->lineno));
+  key->hash = hash_bytes(h, syms, sizeof(mrb_sym) * slen);
+}
+
+static mrb_bool
+code_cache_match_p(struct code_cache_entry *e, struct code_cache_key *key)
+{
+  if (e->hash != key->hash || e->len != key->len || memcmp(e->src, key->src, key->len) != 0) return FALSE;
+  if (!key->filename != !e->filename) return FALSE;
+  if (key->filename && strcmp(key->filename, e->filename) != 0) return FALSE;
+  if (e->lineno != key->lineno || e->slen != key->slen) return FALSE;
+  return key->slen == 0 || memcmp(e->syms, key->syms, sizeof(mrb_sym) * key->slen) == 0;
+}
+
+static void
+lru_unlink(struct mrb_code_cache *cache, struct code_cache_entry *e)
+{
+  if (e->prev) e->prev->next = e->next;
+  else cache->head = e->next;
+  if (e->next) e->next->prev = e->prev;
+  else cache->tail = e->prev;
+}
+
+static void
+lru_push(struct mrb_code_cache *cache, struct code_cache_entry *e)
+{
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head) cache->head->prev = e;
+  else cache->tail = e;
+  cache->head = e;
+}
+
+static void
+entry_free(mrb_state *mrb, struct code_cache_entry *e)
+{
+  if (e->irep) mrb_irep_decref(mrb, e->irep);
+  mrb_free(mrb, e->src);
+  mrb_free(mrb, e->filename);
+  mrb_free(mrb, e->syms);
+  mrb_free(mrb, e->out_syms);
+  mrb_free(mrb, e);
+}
+
+static void
+entry_remove(mrb_state *mrb, struct mrb_code_cache *cache, struct code_cache_entry *e)
+{
+  struct code_cache_entry **pp = &cache->buckets[e->hash & (cache->nbuckets - 1)];
+
+  while (*pp != e) pp = &(*pp)->hnext;
+  *pp = e->hnext;
+  lru_unlink(cache, e);
+  cache->len--;
+  entry_free(mrb, e);
+}
+
+static void*
+dup_bytes(mrb_state *mrb, const void *p, size_t len)
+{
+  void *d;
+
+  if (len == 0) return NULL;
+  d = mrb_malloc(mrb, len);
+  if (d) memcpy(d, p, len);
+  return d;
+}
+
+/* contexts that dump or only compile bypass the cache */
+static mrb_bool
+code_cache_p(mrb_state *mrb, mrbc_context *c)
+{
+  return mrb->code_cache && mrb->code_cache->capa > 0 &&
+    !(c && (c->dump_result || c->no_exec));
+}
+
+/* returns the cached top-level irep of s compiled under c, or NULL */
+mrb_irep*
+mrb_code_cache_get(mrb_state *mrb, const char *s, size_t len, mrbc_context *c)
+{
+  struct mrb_code_cache *cache = mrb->code_cache;
+  struct code_cache_entry *e;
+  struct code_cache_key key;
+
+  if (!code_cache_p(mrb, c)) return NULL;
+  code_cache_key_init(&key, s, len, c, c ? c->syms : NULL, c ? c->slen : 0);
+  for (e = cache->buckets[key.hash & (cache->nbuckets - 1)]; e; e = e->hnext) {
+    if (code_cache_match_p(e, &key)) break;
+  }
+  if (!e) {
+    cache->misses++;
+    return NULL;
+  }
+  cache->hits++;
+  if (cache->head != e) {
+    lru_unlink(cache, e);
+    lru_push(cache, e);
+  }
+  /* the parse would have left these locals in the context */
+  if (c && e->out_slen > 0) {
+    mrb_sym *syms = (mrb_sym *)mrb_realloc(mrb, c->syms, sizeof(mrb_sym) * e->out_slen);
+
+    if (!syms) return NULL;
+    memcpy(syms, e->out_syms, sizeof(mrb_sym) * e->out_slen);
+    c->syms = syms;
+    c->slen = e->out_slen;
+  }
+  else if (c) {
+    c->slen = 0;
+  }
+  return e->irep;
+}
+
+/* caches irep, just compiled from s under c whose locals before the
+   parse were syms[0, slen) */
+void
+mrb_code_cache_put(mrb_state *mrb, const char *s, size_t len, mrbc_context *c, const mrb_sym *syms, int slen, mrb_irep *irep)
+{
+  struct mrb_code_cache *cache = mrb->code_cache;
+  struct code_cache_entry *e, **bucket;
+  struct code_cache_key key;
+
+  if (!code_cache_p(mrb, c) || !irep->unit) return;
+  code_cache_key_init(&key, s, len, c, syms, slen);
+  e = (struct code_cache_entry *)mrb_calloc(mrb, 1, sizeof(struct code_cache_entry));
+  if (!e) return;
+  e->hash = key.hash;
+  e->src = (char *)dup_bytes(mrb, s, len);
+  e->len = len;
+  if (key.filename) e->filename = (char *)dup_bytes(mrb, key.filename, strlen(key.filename) + 1);
+  e->lineno = key.lineno;
+  e->syms = (mrb_sym *)dup_bytes(mrb, syms, sizeof(mrb_sym) * slen);
+  e->slen = slen;
+  if (c) {
+    e->out_syms = (mrb_sym *)dup_bytes(mrb, c->syms, sizeof(mrb_sym) * c->slen);
+    e->out_slen = c->slen;
+  }
+  /* out of memory: the code just runs uncached */
+  if ((len > 0 && !e->src) || (key.filename && !e->filename) ||
+      (slen > 0 && !e->syms) || (e->out_slen > 0 && !e->out_syms)) {
+    entry_free(mrb, e);
+    return;
+  }
+  e->irep = irep;
+  mrb_irep_incref(irep);
+
+  if (cache->len >= cache->capa) {
+    entry_remove(mrb, cache, cache->tail);
+    cache->evictions++;
+  }
+  bucket = &cache->buckets[e->hash & (cache->nbuckets - 1)];
+  e->hnext = *bucket;
+  *bucket = e;
+  lru_push(cache, e);
+  cache->len++;
+}
+
+static void
+code_cache_clear(mrb_state *mrb, struct mrb_code_cache *cache)
+{
+  while (cache->head) {
+    entry_remove(mrb, cache, cache->head);
+  }
+}
+
+/* capa 0 disables the cache and drops every entry */
+void
+mrb_code_cache_set_capacity(mrb_state *mrb, size_t capa)
+{
+  struct mrb_code_cache *cache = mrb->code_cache;
+  size_t nbuckets = 1;
+
+  if (!cache) {
+    if (capa == 0) return;
+    cache = (struct mrb_code_cache *)mrb_calloc(mrb, 1, sizeof(struct mrb_code_cache));
+    if (!cache) return;
+    mrb->code_cache = cache;
+  }
+  while (cache->len > capa) {
+    entry_remove(mrb, cache, cache->tail);
+    cache->evictions++;
+  }
+  cache->capa = capa;
+  if (capa == 0) return;
+
+  while (nbuckets < capa) nbuckets <<= 1;
+  if (nbuckets != cache->nbuckets) {
+    struct code_cache_entry **buckets, *e;
+
+    buckets = (struct code_cache_entry **)mrb_calloc(mrb, nbuckets, sizeof(struct code_cache_entry *));
+    if (!buckets) {
+      /* keep the old buckets; their chains just grow longer */
+      if (cache->nbuckets == 0) cache->capa = 0;
+      return;
+    }
+    for (e = cache->head; e; e = e->next) {
+      e->hnext = buckets[e->hash & (nbuckets - 1)];
+      buckets[e->hash & (nbuckets - 1)] = e;
+    }
+    mrb_free(mrb, cache->buckets);
+    cache->buckets = buckets;
+    cache->nbuckets = nbuckets;
+  }
+}
+
+void
+mrb_code_cache_stat(mrb_state *mrb, struct mrb_code_cache_stat *stat)
+{
+  struct mrb_code_cache *cache = mrb->code_cache;
+
+  memset(stat, 0, sizeof(*stat));
+  if (!cache) return;
+  stat->capacity = cache->capa;
+  stat->entries = cache->len;
+  stat->hits = cache->hits;
+  stat->misses = cache->misses;
+  stat->evictions = cache->evictions;
+}
+
+void
+mrb_free_code_cache(mrb_state *mrb)
+{
+  struct mrb_code_cache *cache = mrb->code_cache;
+
+  if (!cache) return;
+  code_cache_clear(mrb, cache);
+  mrb_free(mrb, cache->buckets);
+  mrb_free(mrb, cache);
+  mrb->code_cache = NULL;
+}
@@ -55,7 +55,7 @@ typedef struct scope {
   short lineno;
 
   mrb_code *iseq;
-  short *lines;
+  uint16_t *lines;
   int icapa;
 
   mrb_irep *irep;
@@ -141,7 +141,7 @@ genop(codegen_scope *s, mrb_code i)
     s->icapa *= 2;
     s->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->icapa);
     if (s->lines) {
-      s->lines = (short*)codegen_realloc(s, s->lines, sizeof(short)*s->icapa);
+      s->lines = (uint16_t*)codegen_realloc(s, s->lines, sizeof(uint16_t)*s->icapa);
     }
   }
   s->iseq[s->pc] = i;
@@ -455,6 +455,7 @@ new_lit(codegen_scope *s, mrb_value val)
   }
   s->irep->pool[s->irep->plen] = val;
   i = s->irep->plen++;
+  mrb_irep_pool_barrier(s->mrb, s->irep);
 
   return i;
 }
@@ -827,6 +828,33 @@ gen_call(codegen_scope *s, node *tree, mrb_sym name, int sp, int val)
     else if (!noop && len == 2 && name[0] == '=' && name[1] == '=')  {
       genop(s, MKOP_ABC(OP_EQ, cursp(), idx, n));
     }
+    else if (!noop && n == 1 && len == 1 && name[0] == '%')  {
+      genop(s, MKOP_ABC(OP_MOD, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 2 && name[0] == '<' && name[1] == '<')  {
+      genop(s, MKOP_ABC(OP_SHL, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 2 && name[0] == '>' && name[1] == '>')  {
+      genop(s, MKOP_ABC(OP_SHR, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 1 && name[0] == '&')  {
+      genop(s, MKOP_ABC(OP_BAND, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 1 && name[0] == '|')  {
+      genop(s, MKOP_ABC(OP_BOR, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 1 && name[0] == '^')  {
+      genop(s, MKOP_ABC(OP_BXOR, cursp(), idx, n));
+    }
+    else if (!noop && n == 0 && len == 2 && name[0] == '-' && name[1] == '@')  {
+      genop(s, MKOP_ABC(OP_NEG, cursp(), idx, n));
+    }
+    else if (!noop && n == 1 && len == 2 && name[0] == '[' && name[1] == ']')  {
+      genop(s, MKOP_ABC(OP_GETIDX, cursp(), idx, n));
+    }
+    else if (!noop && n == 2 && len == 3 && name[0] == '[' && name[1] == ']' && name[2] == '=')  {
+      genop(s, MKOP_ABC(OP_SETIDX, cursp(), idx, n));
+    }
     else {
       if (sendv) n = CALL_MAXARGS;
       if (blk > 0) {                   /* no block */
@@ -1608,6 +1636,24 @@ codegen(codegen_scope *s, node *tree, int val)
       else if (len == 2 && name[0] == '>' && name[1] == '=')  {
         genop(s, MKOP_ABC(OP_GE, cursp(), idx, 1));
       }
+      else if (len == 1 && name[0] == '%')  {
+        genop(s, MKOP_ABC(OP_MOD, cursp(), idx, 1));
+      }
+      else if (len == 2 && name[0] == '<' && name[1] == '<')  {
+        genop(s, MKOP_ABC(OP_SHL, cursp(), idx, 1));
+      }
+      else if (len == 2 && name[0] == '>' && name[1] == '>')  {
+        genop(s, MKOP_ABC(OP_SHR, cursp(), idx, 1));
+      }
+      else if (len == 1 && name[0] == '&')  {
+        genop(s, MKOP_ABC(OP_BAND, cursp(), idx, 1));
+      }
+      else if (len == 1 && name[0] == '|')  {
+        genop(s, MKOP_ABC(OP_BOR, cursp(), idx, 1));
+      }
+      else if (len == 1 && name[0] == '^')  {
+        genop(s, MKOP_ABC(OP_BXOR, cursp(), idx, 1));
+      }
       else {
         genop(s, MKOP_ABC(OP_SEND, cursp(), idx, 1));
       }
@@ -2392,7 +2438,7 @@ scope_new(mrb_state *mrb, codegen_scope *prev, node *lv)
 
   p->filename = prev->filename;
   if (p->filename) {
-    p->lines = (short*)mrb_malloc(mrb, sizeof(short)*p->icapa);
+    p->lines = (uint16_t*)mrb_malloc(mrb, sizeof(uint16_t)*p->icapa);
   }
   p->lineno = prev->lineno;
   return p;
@@ -2409,10 +2455,11 @@ scope_finish(codegen_scope *s)
     irep->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->pc);
     irep->ilen = s->pc;
     if (s->lines) {
-      irep->lines = (uint16_t *)codegen_realloc(s, s->lines, sizeof(uint16_t)*s->pc);
+      irep->line_table = mrb_irep_line_table(mrb, s->lines, s->pc);
+      mrb_free(mrb, s->lines);
     }
     else {
-      irep->lines = 0;
+      irep->line_table = 0;
     }
   }
   irep->pool = (mrb_value *)codegen_realloc(s, irep->pool, sizeof(mrb_value)*irep->plen);
@@ -2727,6 +2774,51 @@ codedump(mrb_state *mrb, int n)
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
              GETARG_C(c));
       break;
+    case OP_MOD:
+      printf("OP_MOD\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_SHL:
+      printf("OP_SHL\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_SHR:
+      printf("OP_SHR\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_BAND:
+      printf("OP_BAND\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_BOR:
+      printf("OP_BOR\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_BXOR:
+      printf("OP_BXOR\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_NEG:
+      printf("OP_NEG\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_GETIDX:
+      printf("OP_GETIDX\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_SETIDX:
+      printf("OP_SETIDX\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
 
     case OP_STOP:
       printf("OP_STOP\n");
@@ -2818,9 +2910,11 @@ codedump(mrb_state *mrb, int n)
 void
 codedump_all(mrb_state *mrb, int start)
 {
-  size_t i;
+  mrb_irep *irep = mrb->irep[start];
+  size_t i, end = mrb->irep_len;
 
-  for (i=start; i<mrb->irep_len; i++) {
+  if (irep->unit == irep) end = start + irep->unit_len;
+  for (i=start; i<end; i++) {
     codedump(mrb, i);
   }
 }
@@ -2855,5 +2949,5 @@ mrb_generate_code(mrb_state *mrb, parser_state *p)
   n = codegen_start(mrb, p);
   if (n < 0) return n;
 
-  return start;
+  return (int)mrb_irep_seal(mrb, start);
 }
@@ -12,7 +12,17 @@
 #include "mruby/irep.h"
 #include "mruby/numeric.h"
 
-static size_t get_irep_record_size(mrb_state *mrb, mrb_irep *irep);
+static size_t get_irep_record_size(mrb_state *mrb, mrb_irep *irep, size_t offset);
+
+/* a sealed unit is dumped on its own, other ireps up to irep_len */
+static size_t
+dump_end(mrb_state *mrb, size_t start_index)
+{
+  mrb_irep *irep = mrb->irep[start_index];
+
+  if (irep->unit == irep) return start_index + irep->unit_len;
+  return mrb->irep_len;
+}
 
 static uint32_t
 get_irep_header_size(mrb_state *mrb)
@@ -26,11 +36,11 @@ get_irep_header_size(mrb_state *mrb)
 }
 
 static size_t
-write_irep_header(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_irep_header(mrb_state *mrb, mrb_irep *irep, uint32_t record_size, uint8_t *buf)
 {
   uint8_t *cur = buf;
 
-  cur += uint32_to_bin(get_irep_record_size(mrb, irep), cur);  /* record size */
+  cur += uint32_to_bin(record_size, cur);  /* record size */
   cur += uint16_to_bin((uint16_t)irep->nlocals, cur);  /* number of local variable */
   cur += uint16_to_bin((uint16_t)irep->nregs, cur);  /* number of register variable */
 
@@ -38,25 +48,40 @@ write_irep_header(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
 }
 
 
+/* padding that brings an image offset to MRB_DUMP_ALIGNMENT */
+static size_t
+get_iseq_padding(size_t offset)
+{
+  return (-offset) & (MRB_DUMP_ALIGNMENT - 1);
+}
+
+/* offset is the position of the block in the whole image */
 static uint32_t
-get_iseq_block_size(mrb_state *mrb, mrb_irep *irep)
+get_iseq_block_size(mrb_state *mrb, mrb_irep *irep, size_t offset)
 {
   uint32_t size = 0;
   size += sizeof(uint32_t); /* ilen */
+  size += sizeof(uint8_t); /* padding length */
+  size += get_iseq_padding(offset + size); /* padding */
   size += sizeof(uint32_t) * irep->ilen; /* iseq(n) */
   return size;
 }
 
+/* iseq is written in host byte order at an aligned image offset so that
+   the loader can execute it in place */
 static int
-write_iseq_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_iseq_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf, size_t offset)
 {
   uint8_t *cur = buf;
-  size_t iseq_no;
+  size_t pad;
 
   cur += uint32_to_bin(irep->ilen, cur); /* number of opcode */
-  for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
-    cur += uint32_to_bin(irep->iseq[iseq_no], cur); /* opcode */
-  }
+  pad = get_iseq_padding(offset + (cur - buf) + sizeof(uint8_t));
+  cur += uint8_to_bin((uint8_t)pad, cur); /* padding length */
+  memset(cur, 0, pad);
+  cur += pad;
+  memcpy(cur, irep->iseq, sizeof(mrb_code) * irep->ilen); /* opcodes */
+  cur += sizeof(mrb_code) * irep->ilen;
 
   return (cur - buf);
 }
@@ -67,33 +92,35 @@ get_pool_block_size(mrb_state *mrb, mrb_irep *irep)
 {
   size_t size = 0;
   size_t pool_no;
-  int len;
   mrb_value str;
-  char buf[32];
 
   size += sizeof(uint32_t); /* plen */
-  size += irep->plen * (sizeof(uint8_t) + sizeof(uint16_t)); /* len(n) */
+  size += irep->plen * sizeof(uint8_t); /* tt(n) */
 
   for (pool_no = 0; pool_no < irep->plen; pool_no++) {
     int ai = mrb_gc_arena_save(mrb);
 
     switch (mrb_type(irep->pool[pool_no])) {
     case MRB_TT_FIXNUM:
-      str = mrb_fixnum_to_str(mrb, irep->pool[pool_no], 10);
-      size += RSTRING_LEN(str);
+      if (mrb_fixnum(irep->pool[pool_no]) < INT32_MIN ||
+          mrb_fixnum(irep->pool[pool_no]) > INT32_MAX)
+        size += sizeof(int64_t);
+      else
+        size += sizeof(int32_t);
       break;
 
     case MRB_TT_FLOAT:
-      len = mrb_float_to_str(buf, mrb_float(irep->pool[pool_no]));
-      size += len;
+      size += sizeof(double);
       break;
 
     case MRB_TT_STRING:
       str = mrb_str_to_str(mrb, irep->pool[pool_no]);
+      size += sizeof(uint16_t); /* len */
       size += RSTRING_LEN(str);
       break;
 
     default:
+      size += sizeof(uint16_t); /* written as an empty string */
       break;
     }
 
@@ -103,6 +130,8 @@ get_pool_block_size(mrb_state *mrb, mrb_irep *irep)
   return size;
 }
 
+/* numbers are stored in binary so that loading them needs neither an
+   RString nor a text conversion, and floats round-trip exactly */
 static int
 write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
 {
@@ -110,109 +139,185 @@ write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
   uint8_t *cur = buf;
   size_t len;
   mrb_value str;
-  const char *char_ptr;
-  char char_buf[30];
+  mrb_int i;
+  double f;
+  uint64_t u;
 
   cur += uint32_to_bin(irep->plen, cur); /* number of pool */
 
   for (pool_no = 0; pool_no < irep->plen; pool_no++) {
-    int ai = mrb_gc_arena_save(mrb);
-
-    cur += uint8_to_bin(mrb_type(irep->pool[pool_no]), cur); /* data type */
-
     switch (mrb_type(irep->pool[pool_no])) {
     case MRB_TT_FIXNUM:
-      str = mrb_fixnum_to_str(mrb, irep->pool[pool_no], 10);
-      char_ptr = RSTRING_PTR(str);
-      len = RSTRING_LEN(str);
+      i = mrb_fixnum(irep->pool[pool_no]);
+      if (i < INT32_MIN || i > INT32_MAX) {
+        cur += uint8_to_bin(IREP_TT_INT64, cur); /* data type */
+        cur += uint64_to_bin((uint64_t)(int64_t)i, cur);
+      }
+      else {
+        cur += uint8_to_bin(IREP_TT_INT32, cur); /* data type */
+        cur += uint32_to_bin((uint32_t)(int32_t)i, cur);
+      }
       break;
 
     case MRB_TT_FLOAT:
-      len = mrb_float_to_str(char_buf, mrb_float(irep->pool[pool_no]));
-      char_ptr = &char_buf[0];
+      f = (double)mrb_float(irep->pool[pool_no]);
+      memcpy(&u, &f, sizeof(double));
+      cur += uint8_to_bin(IREP_TT_FLOAT, cur); /* data type */
+      cur += uint64_to_bin(u, cur);
       break;
 
     case MRB_TT_STRING:
       str = irep->pool[pool_no];
-      char_ptr = RSTRING_PTR(str);
       len = RSTRING_LEN(str);
+      cur += uint8_to_bin(IREP_TT_STRING, cur); /* data type */
+      cur += uint16_to_bin(len, cur); /* data length */
+      memcpy(cur, RSTRING_PTR(str), len);
+      cur += len;
       break;
 
     default:
-      continue;
+      cur += uint8_to_bin(IREP_TT_STRING, cur); /* data type */
+      cur += uint16_to_bin(0, cur); /* data length */
+      break;
     }
+  }
 
-    cur += uint16_to_bin(len, cur); /* data length */
-    memcpy(cur, char_ptr, len);
-    cur += len;
+  return (int)(cur - buf);
+}
 
-    mrb_gc_arena_restore(mrb, ai);
+
+/* symbols of all dumped ireps, deduplicated into the SYMS section */
+struct dump_symtbl {
+  uint32_t *index;        /* symbol -> position in syms + 1 */
+  mrb_sym *syms;
+  uint32_t len;
+};
+
+static int
+symtbl_init(mrb_state *mrb, size_t start_index, struct dump_symtbl *tbl)
+{
+  size_t irep_no, sym_no;
+  mrb_irep *irep;
+  mrb_sym sym;
+
+  tbl->len = 0;
+  tbl->syms = NULL;
+  tbl->index = (uint32_t *)mrb_calloc(mrb, mrb->symidx + 1, sizeof(uint32_t));
+  if (tbl->index == NULL) {
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+  for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
+    irep = mrb->irep[irep_no];
+    for (sym_no = 0; sym_no < irep->slen; sym_no++) {
+      sym = irep->syms[sym_no];
+      if (sym == 0 || tbl->index[sym] != 0) continue;
+      tbl->index[sym] = ++tbl->len;
+    }
+  }
+  if (tbl->len > 0) {
+    tbl->syms = (mrb_sym *)mrb_malloc(mrb, sizeof(mrb_sym) * tbl->len);
+    if (tbl->syms == NULL) {
+      return MRB_DUMP_GENERAL_FAILURE;
+    }
+    for (sym = 1; sym <= mrb->symidx; sym++) {
+      if (tbl->index[sym] != 0) {
+        tbl->syms[tbl->index[sym] - 1] = sym;
+      }
+    }
   }
 
-  return (int)(cur - buf);
+  return MRB_DUMP_OK;
 }
 
+static void
+symtbl_free(mrb_state *mrb, struct dump_symtbl *tbl)
+{
+  mrb_free(mrb, tbl->index);
+  mrb_free(mrb, tbl->syms);
+}
 
 static size_t
 get_syms_block_size(mrb_state *mrb, mrb_irep *irep)
 {
   size_t size = 0;
-  size_t sym_no;
-  size_t len;
 
   size += sizeof(uint32_t); /* slen */
-  for (sym_no = 0; sym_no < irep->slen; sym_no++) {
-    size += sizeof(uint16_t); /* snl(n) */
-    if (irep->syms[sym_no] != 0) {
-      mrb_sym2name_len(mrb, irep->syms[sym_no], &len);
-      size += len + 1; /* sn(n) + null char */
-    }
-  }
+  size += sizeof(uint32_t) * irep->slen; /* index(n) */
 
   return size;
 }
 
 static int
-write_syms_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_syms_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf, struct dump_symtbl *tbl)
 {
   size_t sym_no;
   uint8_t *cur = buf;
-  const char *name;
 
   cur += uint32_to_bin(irep->slen, cur); /* number of symbol */
 
   for (sym_no = 0; sym_no < irep->slen; sym_no++) {
     if (irep->syms[sym_no] != 0) {
-      size_t len;
-
-      name = mrb_sym2name_len(mrb, irep->syms[sym_no], &len);
-      if (len > UINT16_MAX) {
-        return MRB_DUMP_GENERAL_FAILURE;
-      }
-
-      cur += uint16_to_bin((uint16_t)len, cur); /* length of symbol name */
-      memcpy(cur, name, len); /* symbol name */
-      cur += (uint16_t)len;
-      *cur++ = '\0';
+      cur += uint32_to_bin(tbl->index[irep->syms[sym_no]] - 1, cur); /* index into SYMS */
     }
     else {
-      cur += uint16_to_bin(MRB_DUMP_NULL_SYM_LEN, cur); /* length of symbol name */
+      cur += uint32_to_bin(MRB_DUMP_NULL_SYM_INDEX, cur);
     }
   }
 
   return (int)(cur - buf);
 }
 
+static size_t
+get_section_syms_size(mrb_state *mrb, struct dump_symtbl *tbl)
+{
+  size_t size = 0;
+  size_t sym_no;
+  size_t len;
+
+  size += sizeof(struct rite_section_syms_header);
+  for (sym_no = 0; sym_no < tbl->len; sym_no++) {
+    mrb_sym2name_len(mrb, tbl->syms[sym_no], &len);
+    size += sizeof(uint16_t) + len + 1; /* snl(n) + sn(n) + null char */
+  }
+
+  return size;
+}
+
+static int
+mrb_write_section_syms(mrb_state *mrb, struct dump_symtbl *tbl, uint8_t *bin)
+{
+  struct rite_section_syms_header *header = (struct rite_section_syms_header*)bin;
+  uint8_t *cur = bin + sizeof(struct rite_section_syms_header);
+  size_t sym_no;
+  const char *name;
+  size_t len;
+
+  for (sym_no = 0; sym_no < tbl->len; sym_no++) {
+    name = mrb_sym2name_len(mrb, tbl->syms[sym_no], &len);
+    if (len > UINT16_MAX) {
+      return MRB_DUMP_GENERAL_FAILURE;
+    }
+    cur += uint16_to_bin((uint16_t)len, cur); /* length of symbol name */
+    memcpy(cur, name, len); /* symbol name */
+    cur += len;
+    *cur++ = '\0';
+  }
 
+  memcpy(header->section_identify, RITE_SECTION_SYMS_IDENTIFIER, sizeof(header->section_identify));
+  uint32_to_bin(cur - bin, header->section_size);
+  uint32_to_bin(tbl->len, header->nsyms);
+
+  return MRB_DUMP_OK;
+}
 
 static size_t
-get_irep_record_size(mrb_state *mrb, mrb_irep *irep)
+get_irep_record_size(mrb_state *mrb, mrb_irep *irep, size_t offset)
 {
   uint32_t size = 0;
 
   //size += sizeof(uint16_t); /* rlen */
   size += get_irep_header_size(mrb);
-  size += get_iseq_block_size(mrb, irep);
+  size += get_iseq_block_size(mrb, irep, offset + size);
   size += get_pool_block_size(mrb, irep);
   size += get_syms_block_size(mrb, irep);
 
@@ -220,13 +325,15 @@ get_irep_record_size(mrb_state *mrb, mrb_irep *irep)
 }
 
 static int
-write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin, uint32_t *irep_record_size)
+write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin, uint32_t *irep_record_size, size_t offset, struct dump_symtbl *tbl)
 {
+  uint8_t *cur = bin;
+
   if (irep == NULL) {
     return MRB_DUMP_INVALID_IREP;
   }
 
-  *irep_record_size = get_irep_record_size(mrb, irep);
+  *irep_record_size = get_irep_record_size(mrb, irep, offset);
   if (*irep_record_size == 0) {
     return MRB_DUMP_GENERAL_FAILURE;
   }
@@ -234,10 +341,10 @@ write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin, uint32_t *irep_r
   memset(bin, 0, *irep_record_size);
 
   //bin += uint16_to_bin(*irep_record_size, bin);
-  bin += write_irep_header(mrb, irep, bin);
-  bin += write_iseq_block(mrb, irep, bin);
-  bin += write_pool_block(mrb, irep, bin);
-  bin += write_syms_block(mrb, irep, bin);
+  cur += write_irep_header(mrb, irep, *irep_record_size, cur);
+  cur += write_iseq_block(mrb, irep, cur, offset + (cur - bin));
+  cur += write_pool_block(mrb, irep, cur);
+  cur += write_syms_block(mrb, irep, cur, tbl);
 
   return MRB_DUMP_OK;
 }
@@ -270,7 +377,7 @@ mrb_write_section_irep_header(mrb_state *mrb, uint32_t section_size, uint16_t ni
 }
 
 static int
-mrb_write_section_irep(mrb_state *mrb, size_t start_index, uint8_t *bin)
+mrb_write_section_irep(mrb_state *mrb, size_t start_index, uint8_t *bin, size_t offset, struct dump_symtbl *tbl)
 {
   int result;
   size_t irep_no;
@@ -284,8 +391,8 @@ mrb_write_section_irep(mrb_state *mrb, size_t start_index, uint8_t *bin)
   cur += sizeof(struct rite_section_irep_header);
   section_size += sizeof(struct rite_section_irep_header);
 
-  for (irep_no = start_index; irep_no < mrb->irep_len; irep_no++) {
-    result = write_irep_record(mrb, mrb->irep[irep_no], cur, &rlen);
+  for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
+    result = write_irep_record(mrb, mrb->irep[irep_no], cur, &rlen, offset + (cur - bin), tbl);
     if (result != MRB_DUMP_OK) {
       return result;
     }
@@ -293,7 +400,9 @@ mrb_write_section_irep(mrb_state *mrb, size_t start_index, uint8_t *bin)
     section_size += rlen;
   }
 
-  mrb_write_section_irep_header(mrb, section_size, mrb->irep_len - start_index, start_index, bin);
+  /* the loader takes sirep relative to the first record, which is always
+     the top-level irep of the dumped range */
+  mrb_write_section_irep_header(mrb, section_size, dump_end(mrb, start_index) - start_index, 0, bin);
 
   return MRB_DUMP_OK;
 }
@@ -323,8 +432,9 @@ get_debug_record_size(mrb_state *mrb, mrb_irep *irep)
     size += strlen(irep->filename); // filename
   }
   size += sizeof(uint32_t); // niseq
-  if (irep->lines) {
-    size += sizeof(uint16_t) * irep->ilen; // lineno
+  if (irep->line_table) {
+    size += sizeof(uint32_t); // line table size
+    size += mrb_irep_line_table_size(irep->line_table, irep->ilen);
   }
 
   return size;
@@ -335,7 +445,7 @@ write_lineno_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin)
 {
   uint8_t *cur = bin;
   size_t filename_len = 0;
-  int iseq_no;
+  size_t table_size;
 
   cur += sizeof(uint32_t); /* record size */
 
@@ -349,11 +459,12 @@ write_lineno_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin)
     cur += filename_len; /* filename */
   }
 
-  if (irep->lines) {
+  if (irep->line_table) {
+    table_size = mrb_irep_line_table_size(irep->line_table, irep->ilen);
     cur += uint32_to_bin(irep->ilen, cur); /* niseq */
-    for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
-      cur += uint16_to_bin(irep->lines[iseq_no], cur); /* opcode */
-    }
+    cur += uint32_to_bin(table_size, cur); /* line table size */
+    memcpy(cur, irep->line_table, table_size);
+    cur += table_size;
   }
   else {
     cur += uint32_to_bin(0, cur); /* niseq */
@@ -378,76 +489,124 @@ mrb_write_section_lineno(mrb_state *mrb, int start_index, uint8_t *bin)
   cur += sizeof(struct rite_section_lineno_header);
   section_size += sizeof(struct rite_section_lineno_header);
 
-  for (irep_no = start_index; irep_no < mrb->irep_len; irep_no++) {
+  for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
     rlen = write_lineno_record(mrb, mrb->irep[irep_no], cur);
     cur += rlen;
     section_size += rlen;
   }
 
-  mrb_write_section_lineno_header(mrb, section_size, mrb->irep_len - start_index, start_index, bin);
+  mrb_write_section_lineno_header(mrb, section_size, dump_end(mrb, start_index) - start_index, 0, bin);
 
   return MRB_DUMP_OK;
 }
 
+/* CRC-32C of everything after this section; replaces the header CRC */
 static int
-write_rite_binary_header(mrb_state *mrb, size_t binary_size, uint8_t* bin)
+mrb_write_section_crc32c(mrb_state *mrb, uint8_t *bin, const uint8_t *end)
+{
+  struct rite_section_crc32c_header *header = (struct rite_section_crc32c_header*)bin;
+  uint8_t *body = bin + sizeof(struct rite_section_crc32c_header);
+
+  memcpy(header->section_identify, RITE_SECTION_CRC32C_IDENTIFIER, sizeof(header->section_identify));
+  uint32_to_bin(sizeof(struct rite_section_crc32c_header), header->section_size);
+  uint32_to_bin(calc_crc_32c(body, end - body, 0), header->crc);
+
+  return MRB_DUMP_OK;
+}
+
+static int
+write_rite_binary_header(mrb_state *mrb, size_t binary_size, uint8_t* bin, int flags)
 { 
   struct rite_binary_header *header = (struct rite_binary_header*)bin;
-  uint16_t crc;
+  uint16_t crc = 0;
   size_t offset;
 
-  memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify));
+  if (bigendian_p())
+    memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify));
+  else
+    memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER_LIL, sizeof(header->binary_identify));
   memcpy(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version));
   memcpy(header->compiler_name, RITE_COMPILER_NAME, sizeof(header->compiler_name));
   memcpy(header->compiler_version, RITE_COMPILER_VERSION, sizeof(header->compiler_version));
   uint32_to_bin(binary_size, header->binary_size);
   
   offset = (&(header->binary_crc[0]) - bin) + sizeof(uint16_t);
-  crc = calc_crc_16_ccitt(bin + offset, binary_size - offset, 0);
+  if (!(flags & DUMP_CRC32C)) {
+    crc = calc_crc_16_ccitt(bin + offset, binary_size - offset, 0);
+  }
   uint16_to_bin(crc, header->binary_crc);
 
   return MRB_DUMP_OK;
 }
 
-static int
-mrb_dump_irep(mrb_state *mrb, size_t start_index, int debug_info, uint8_t **bin, size_t *bin_size)
+int
+mrb_dump_irep(mrb_state *mrb, size_t start_index, int flags, uint8_t **bin, size_t *bin_size)
 {
   int result = MRB_DUMP_GENERAL_FAILURE;
   size_t section_size = 0;
+  size_t section_crc_size = 0;
   size_t section_irep_size;
   size_t section_lineno_size = 0;
+  size_t section_syms_size;
   size_t irep_no;
   uint8_t *cur = NULL;
+  struct dump_symtbl symtbl;
 
-  if (mrb == NULL || start_index >= mrb->irep_len) {
-    *bin = NULL;
+  *bin = NULL;
+  if (mrb == NULL || start_index >= mrb->irep_len || mrb->irep[start_index] == NULL) {
     return MRB_DUMP_GENERAL_FAILURE;
   }
+  for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
+    mrb_irep_materialize(mrb, mrb->irep[irep_no]);
+  }
+
+  result = symtbl_init(mrb, start_index, &symtbl);
+  if (result != MRB_DUMP_OK) {
+    goto error_exit;
+  }
+  if (flags & DUMP_CRC32C) {
+    section_crc_size = sizeof(struct rite_section_crc32c_header);
+    section_size += section_crc_size;
+  }
+
+  section_syms_size = get_section_syms_size(mrb, &symtbl);
+  section_size += section_syms_size;
 
   section_irep_size = sizeof(struct rite_section_irep_header);
-  for (irep_no = start_index; irep_no < mrb->irep_len; irep_no++) {
-    section_irep_size += get_irep_record_size(mrb, mrb->irep[irep_no]);
+  for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
+    section_irep_size += get_irep_record_size(mrb, mrb->irep[irep_no],
+                                              sizeof(struct rite_binary_header) + section_size + section_irep_size);
   }
   section_size += section_irep_size;
 
   /* DEBUG section size */
-  if (debug_info) {
+  if (flags & DUMP_DEBUG_INFO) {
     section_lineno_size += sizeof(struct rite_section_lineno_header);
-    for (irep_no = start_index; irep_no < mrb->irep_len; irep_no++) {
+    for (irep_no = start_index; irep_no < dump_end(mrb, start_index); irep_no++) {
       section_lineno_size += get_debug_record_size(mrb, mrb->irep[irep_no]);
     }
     section_size += section_lineno_size;
   }
 
-  *bin_size += sizeof(struct rite_binary_header) + section_size + sizeof(struct rite_binary_footer);
+  *bin_size = sizeof(struct rite_binary_header) + section_size + sizeof(struct rite_binary_footer);
   cur = *bin = (uint8_t *)mrb_malloc(mrb, *bin_size);
   if (cur == NULL) {
+    result = MRB_DUMP_GENERAL_FAILURE;
     goto error_exit;
   }
 
   cur += sizeof(struct rite_binary_header);
+  cur += section_crc_size; /* written last */
 
-  result = mrb_write_section_irep(mrb, start_index, cur);
+  /* SYMS precedes IREP so that the loader can resolve indices at once */
+  result = mrb_write_section_syms(mrb, &symtbl, cur);
+  if (result != MRB_DUMP_OK) {
+    goto error_exit;
+  }
+
+  cur += section_syms_size;
+
+  result = mrb_write_section_irep(mrb, start_index, cur, cur - *bin, &symtbl);
   if (result != MRB_DUMP_OK) {
     goto error_exit;
   }
@@ -455,7 +614,7 @@ mrb_dump_irep(mrb_state *mrb, size_t start_index, int debug_info, uint8_t **bin,
   cur += section_irep_size;
   
   /* write DEBUG section */
-  if (debug_info) {
+  if (flags & DUMP_DEBUG_INFO) {
     result = mrb_write_section_lineno(mrb, start_index, cur);
     if (result != MRB_DUMP_OK) {
       goto error_exit;
@@ -465,9 +624,13 @@ mrb_dump_irep(mrb_state *mrb, size_t start_index, int debug_info, uint8_t **bin,
 
   mrb_write_eof(mrb, cur);
 
-  result = write_rite_binary_header(mrb, *bin_size, *bin);
+  if (flags & DUMP_CRC32C) {
+    mrb_write_section_crc32c(mrb, *bin + sizeof(struct rite_binary_header), *bin + *bin_size);
+  }
+  result = write_rite_binary_header(mrb, *bin_size, *bin, flags);
 
 error_exit:
+  symtbl_free(mrb, &symtbl);
   if (result != MRB_DUMP_OK) {
     mrb_free(mrb, *bin);
     *bin = NULL;
@@ -479,7 +642,7 @@ error_exit:
 #ifdef ENABLE_STDIO
 
 int
-mrb_dump_irep_binary(mrb_state *mrb, size_t start_index, int debug_info, FILE* fp)
+mrb_dump_irep_binary(mrb_state *mrb, size_t start_index, int flags, FILE* fp)
 {
   uint8_t *bin = NULL;
   size_t bin_size = 0;
@@ -489,7 +652,7 @@ mrb_dump_irep_binary(mrb_state *mrb, size_t start_index, int debug_info, FILE* f
     return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  result = mrb_dump_irep(mrb, start_index, debug_info, &bin, &bin_size);
+  result = mrb_dump_irep(mrb, start_index, flags, &bin, &bin_size);
   if (result == MRB_DUMP_OK) {
     fwrite(bin, bin_size, 1, fp);
   }
@@ -515,7 +678,7 @@ is_valid_c_symbol_name(const char *name)
 }
 
 int
-mrb_dump_irep_cfunc(mrb_state *mrb, size_t start_index, int debug_info, FILE *fp, const char *initname)
+mrb_dump_irep_cfunc(mrb_state *mrb, size_t start_index, int flags, FILE *fp, const char *initname)
 {
   uint8_t *bin = NULL;
   size_t bin_size = 0, bin_idx = 0;
@@ -525,10 +688,19 @@ mrb_dump_irep_cfunc(mrb_state *mrb, size_t start_index, int debug_info, FILE *fp
     return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  result = mrb_dump_irep(mrb, start_index, debug_info, &bin, &bin_size);
+  result = mrb_dump_irep(mrb, start_index, flags, &bin, &bin_size);
   if (result == MRB_DUMP_OK) {
     fprintf(fp, "#include <stdint.h>\n"); // for uint8_t under at least Darwin
-    fprintf(fp, "const uint8_t %s[] = {", initname);
+    /* aligned so that mrb_load_irep() runs the iseq in place */
+    fprintf(fp,
+            "const uint8_t\n"
+            "#if defined __GNUC__\n"
+            "__attribute__((aligned(%u)))\n"
+            "#elif defined _MSC_VER\n"
+            "__declspec(align(%u))\n"
+            "#endif\n"
+            "%s[] = {",
+            (unsigned)MRB_DUMP_ALIGNMENT, (unsigned)MRB_DUMP_ALIGNMENT, initname);
     while (bin_idx < bin_size) {
       if (bin_idx % 16 == 0 ) fputs("\n", fp);
       fprintf(fp, "0x%02x,", bin[bin_idx++]);
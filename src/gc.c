@@ -11,15 +11,24 @@
 # include <limits.h>
 #endif
 #include <string.h>
+#include <time.h>
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
 #include "mruby/data.h"
 #include "mruby/hash.h"
+#include "mruby/irep.h"
 #include "mruby/proc.h"
 #include "mruby/range.h"
 #include "mruby/string.h"
 #include "mruby/variable.h"
+#if defined(MRB_GC_PARALLEL_MARK) || defined(MRB_GC_CONCURRENT_SWEEP)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef MRB_GC_MMAP_PAGES
+#include <sys/mman.h>
+#endif
 
 /*
   = Tri-color Incremental Garbage Collection
@@ -52,10 +61,35 @@
   == Execution Timing
 
   GC Execution Time and Each step interval are decided by live objects count.
+  Bytes allocated through mrb_malloc/mrb_realloc since the last cycle are
+  added to the count, gc_malloc_ratio bytes as one object.  Heap pages
+  are not, since their slots are already in the count.
+  When gc_step_budget_us is set, each incremental step instead runs until
+  that many microseconds have passed, checking the clock every
+  gc_step_chunk objects; the chunk adapts to the measured throughput.
   List of Adjustment API:
 
     * gc_interval_ratio_set
     * gc_step_ratio_set
+    * gc_malloc_ratio_set
+    * gc_step_budget_us_set
+
+  == Concurrent Sweeping
+
+  With MRB_GC_CONCURRENT_SWEEP, a helper thread sweeps the heap pages
+  after marking; see concurrent_sweep_start().
+
+  == Page Allocation
+
+  With MRB_GC_MMAP_PAGES, heap pages come from mmap'ed chunks and
+  completely free chunks are returned to the OS after a cycle; see
+  gc_trim_chunks().
+
+  == Parallel Marking
+
+  With MRB_GC_PARALLEL_MARK, mrb_garbage_collect (GC.start) hands the
+  mark phase to gc_mark_workers threads once roots are scanned.
+  Incremental and minor steps always mark on the calling thread.
 
   For details, see the comments for each function.
 
@@ -92,6 +126,52 @@ typedef struct {
   } as;
 } RVALUE;
 
+/*
+  Heap pages come in size classes.  All slots of a page have the same
+  size, and mrb_obj_alloc takes the slot from a page of the class of
+  the object type, so plain objects and hashes do not pay for the
+  largest object type.  Marking and sweeping work on every page alike.
+ */
+enum gc_size_class {
+  GC_SLOT_SMALL,                /* plain objects, exceptions */
+  GC_SLOT_MEDIUM,               /* hashes, ranges, environments */
+  GC_SLOT_LARGE,                /* anything else */
+};
+
+union gc_small_slot {
+  struct free_obj free;
+  struct RObject object;
+};
+
+union gc_medium_slot {
+  union gc_small_slot small;
+  struct RHash hash;
+  struct RRange range;
+  struct REnv env;
+};
+
+static const uint16_t gc_slot_size[MRB_GC_SIZE_CLASSES] = {
+  sizeof(union gc_small_slot),
+  sizeof(union gc_medium_slot),
+  sizeof(RVALUE),
+};
+
+static inline enum gc_size_class
+gc_size_class(enum mrb_vtype tt)
+{
+  switch (tt) {
+  case MRB_TT_OBJECT:
+  case MRB_TT_EXCEPTION:
+    return GC_SLOT_SMALL;
+  case MRB_TT_HASH:
+  case MRB_TT_RANGE:
+  case MRB_TT_ENV:
+    return GC_SLOT_MEDIUM;
+  default:
+    return GC_SLOT_LARGE;
+  }
+}
+
 #ifdef GC_PROFILE
 #include <stdio.h>
 #include <sys/time.h>
@@ -146,8 +226,10 @@ gettimeofday_time(void)
 
 #define GC_STEP_SIZE 1024
 
-void*
-mrb_realloc(mrb_state *mrb, void *p, size_t len)
+/* allocation without accounting, for heap bookkeeping whose slots are
+   already counted */
+static void*
+gc_realloc(mrb_state *mrb, void *p, size_t len)
 {
   void *p2;
 
@@ -174,6 +256,28 @@ mrb_realloc(mrb_state *mrb, void *p, size_t len)
   return p2;
 }
 
+/* mrb_realloc() charging the bytes to objects of type tt */
+void*
+mrb_realloc_tt(mrb_state *mrb, void *p, size_t len, enum mrb_vtype tt)
+{
+  void *p2;
+
+  p2 = gc_realloc(mrb, p, len);
+  if (p2) {
+    /* allocation volume; paces the collector together with mrb->live */
+    mrb->malloc_increase += len;
+    mrb->malloc_increase_old += len;
+    mrb->malloc_bytes[tt] += len;
+  }
+  return p2;
+}
+
+void*
+mrb_realloc(mrb_state *mrb, void *p, size_t len)
+{
+  return mrb_realloc_tt(mrb, p, len, MRB_TT_FALSE);
+}
+
 void*
 mrb_malloc(mrb_state *mrb, size_t len)
 {
@@ -207,6 +311,29 @@ mrb_free(mrb_state *mrb, void *p)
 #define MRB_HEAP_PAGE_SIZE 1024
 #endif
 
+/*
+  Object colors live in a byte map in the page header rather than in
+  the objects, so marking does not write to object memory (pages shared
+  copy-on-write after fork stay shared).  Pages are aligned to
+  GC_PAGE_ALIGN so the page of an object is found by masking its
+  address.  The slot number is found by multiplying the offset with
+  the page's rounded up reciprocal of the slot size, which is exact
+  for offsets of slot boundaries.  Unless MRB_HEAP_PAGE_ALIGN is given,
+  the alignment is the page size rounded up to a power of two.
+ */
+#ifdef MRB_HEAP_PAGE_ALIGN
+#define GC_PAGE_ALIGN ((uintptr_t)MRB_HEAP_PAGE_ALIGN)
+#else
+#define GC_PAGE_BITS1 ((uintptr_t)sizeof(struct heap_page) - 1)
+#define GC_PAGE_BITS2 (GC_PAGE_BITS1 | GC_PAGE_BITS1 >> 1)
+#define GC_PAGE_BITS4 (GC_PAGE_BITS2 | GC_PAGE_BITS2 >> 2)
+#define GC_PAGE_BITS8 (GC_PAGE_BITS4 | GC_PAGE_BITS4 >> 4)
+#define GC_PAGE_BITS16 (GC_PAGE_BITS8 | GC_PAGE_BITS8 >> 8)
+#define GC_PAGE_BITS32 (GC_PAGE_BITS16 | GC_PAGE_BITS16 >> 16)
+#define GC_PAGE_ALIGN (GC_PAGE_BITS32 + 1)
+#endif
+#define GC_PAGE_SLOTS_MAX (MRB_HEAP_PAGE_SIZE * sizeof(RVALUE) / sizeof(union gc_small_slot))
+
 struct heap_page {
   struct RBasic *freelist;
   struct heap_page *prev;
@@ -214,9 +341,62 @@ struct heap_page {
   struct heap_page *free_next;
   struct heap_page *free_prev;
   mrb_bool old:1;
-  RVALUE objects[MRB_HEAP_PAGE_SIZE];
+  uint8_t size_class;           /* enum gc_size_class */
+  uint16_t slot_size;
+  uint32_t slot_inv;            /* 2**32 / slot_size, rounded up */
+  size_t nslots;
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  mrb_bool swept_dead:1;        /* no live object left */
+  int sweep_state;              /* see gc_sweep_job */
+  size_t swept_freed;
+  size_t swept_deferred;        /* dead objects left for the mutator */
+#endif
+#ifdef MRB_GC_MMAP_PAGES
+  struct heap_chunk *chunk;
+#else
+  void *mem;                    /* unaligned allocation */
+#endif
+  uint8_t colors[GC_PAGE_SLOTS_MAX];
+  RVALUE objects[MRB_HEAP_PAGE_SIZE]; /* nslots slots of slot_size bytes */
 };
 
+#ifdef MRB_HEAP_PAGE_ALIGN
+/* MRB_HEAP_PAGE_ALIGN must be a power of two not less than the page */
+typedef char heap_page_fits_align[sizeof(struct heap_page) <= MRB_HEAP_PAGE_ALIGN ? 1 : -1];
+#endif
+
+#define page_of(o) ((struct heap_page*)((uintptr_t)(o) & ~(GC_PAGE_ALIGN - 1)))
+
+#define page_slot(page, i) ((struct RBasic*)((char*)(page)->objects + (size_t)(i) * (page)->slot_size))
+#define slot_index(page, o) ((size_t)(((uint64_t)((char*)(o) - (char*)(page)->objects) * (page)->slot_inv) >> 32))
+
+/* color of a slot without an object, so that the sweep helper can
+   tell free slots from live objects without reading their headers,
+   which the mutator may be writing */
+#define GC_FREE_SLOT (1 << 3)
+
+#define gc_color_ref(o) (page_of(o)->colors[slot_index(page_of(o), o)])
+#ifdef MRB_GC_CONCURRENT_SWEEP
+/* the sweep helper reads and repaints the colors of pending pages while
+   write barriers may paint the same bytes */
+#define gc_color(o) ((int)__atomic_load_n(&gc_color_ref(o), __ATOMIC_RELAXED))
+#define gc_paint(o, color) __atomic_store_n(&gc_color_ref(o), (uint8_t)(color), __ATOMIC_RELAXED)
+#else
+#define gc_color(o) ((int)gc_color_ref(o))
+#define gc_paint(o, color) (gc_color_ref(o) = (uint8_t)(color))
+#endif
+
+#define paint_gray(o) gc_paint((o), MRB_GC_GRAY)
+#define paint_black(o) gc_paint((o), MRB_GC_BLACK)
+#define paint_white(o) gc_paint((o), MRB_GC_WHITES)
+#define paint_partial_white(s, o) gc_paint((o), (s)->current_white_part)
+#define is_gray(o) (gc_color(o) == MRB_GC_GRAY)
+#define is_white(o) (gc_color(o) & MRB_GC_WHITES)
+#define is_black(o) (gc_color(o) & MRB_GC_BLACK)
+#define is_dead(s, o) (((o)->tt == MRB_TT_FREE) || (gc_color(o) & other_white_part(s) & MRB_GC_WHITES))
+#define flip_white_part(s) ((s)->current_white_part = other_white_part(s))
+#define other_white_part(s) ((s)->current_white_part ^ MRB_GC_WHITES)
+
 static void
 link_heap_page(mrb_state *mrb, struct heap_page *page)
 {
@@ -242,11 +422,13 @@ unlink_heap_page(mrb_state *mrb, struct heap_page *page)
 static void
 link_free_heap_page(mrb_state *mrb, struct heap_page *page)
 {
-  page->free_next = mrb->free_heaps;
-  if (mrb->free_heaps) {
-    mrb->free_heaps->free_prev = page;
+  struct heap_page **head = &mrb->free_heaps[page->size_class];
+
+  page->free_next = *head;
+  if (*head) {
+    (*head)->free_prev = page;
   }
-  mrb->free_heaps = page;
+  *head = page;
 }
 
 static void
@@ -256,23 +438,203 @@ unlink_free_heap_page(mrb_state *mrb, struct heap_page *page)
     page->free_prev->free_next = page->free_next;
   if (page->free_next)
     page->free_next->free_prev = page->free_prev;
-  if (mrb->free_heaps == page)
-    mrb->free_heaps = page->free_next;
+  if (mrb->free_heaps[page->size_class] == page)
+    mrb->free_heaps[page->size_class] = page->free_next;
   page->free_prev = NULL;
   page->free_next = NULL;
 }
 
+#ifdef MRB_GC_MMAP_PAGES
+/*
+  Pages are carved out of GC_CHUNK_PAGES page chunks mapped with mmap
+  and aligned to their size, so that once the heap has grown past
+  gc_huge_page_threshold pages new chunks can be backed by transparent
+  huge pages.  A freed page goes back to its chunk.  At the end of a
+  cycle, chunks with no page in use are released with MADV_DONTNEED
+  while more than gc_trim_threshold free pages remain resident; their
+  address range stays mapped and is reused before a new chunk is.
+  Residency is tracked per page: a page of a trimmed chunk is resident
+  again only once it has been handed out.
+  Chunk bookkeeping lives outside the chunk, since trimming drops the
+  chunk's contents.
+ */
+#define GC_CHUNK_PAGES 32
+#define GC_CHUNK_SIZE (GC_PAGE_ALIGN * GC_CHUNK_PAGES)
+#define GC_CHUNK_ALL_USED ((uint32_t)0xffffffff)
+#define DEFAULT_GC_HUGE_PAGE_THRESHOLD 256
+#define DEFAULT_GC_TRIM_THRESHOLD GC_CHUNK_PAGES
+
+struct heap_chunk {
+  struct heap_chunk *next;
+  char *base;
+  uint32_t used;                /* bit per page in use */
+  uint32_t resident;            /* bit per page touched since the last trim */
+};
+
+static int
+chunk_page_count(uint32_t bits)
+{
+  int n = 0;
+
+  for (; bits; bits &= bits - 1) n++;
+  return n;
+}
+
+static struct heap_chunk*
+map_chunk(mrb_state *mrb)
+{
+  struct heap_chunk *chunk;
+  char *raw, *base;
+  size_t head;
+
+  chunk = (struct heap_chunk*)gc_realloc(mrb, NULL, sizeof(struct heap_chunk));
+  raw = (char*)mmap(NULL, GC_CHUNK_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (raw == (char*)MAP_FAILED) {
+    mrb_free(mrb, chunk);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "Out of memory");
+  }
+  base = (char*)(((uintptr_t)raw + GC_CHUNK_SIZE - 1) & ~(GC_CHUNK_SIZE - 1));
+  head = base - raw;
+  if (head > 0) munmap(raw, head);
+  munmap(base + GC_CHUNK_SIZE, GC_CHUNK_SIZE - head);
+#ifdef MADV_HUGEPAGE
+  if (mrb->gc_huge_page_threshold > 0 && mrb->heap_pages >= mrb->gc_huge_page_threshold) {
+    madvise(base, GC_CHUNK_SIZE, MADV_HUGEPAGE);
+  }
+#endif
+  chunk->base = base;
+  chunk->used = 0;
+  chunk->resident = 0;
+  chunk->next = mrb->heap_chunks;
+  mrb->heap_chunks = chunk;
+  return chunk;
+}
+
+static struct heap_page*
+gc_page_alloc(mrb_state *mrb)
+{
+  struct heap_chunk *chunk, *best = NULL;
+  struct heap_page *page;
+  uint32_t avail;
+  int i;
+
+  /* reuse a free resident page, filling the fullest chunk so that
+     others can empty out */
+  for (chunk = mrb->heap_chunks; chunk; chunk = chunk->next) {
+    mrb_bool warm = (chunk->resident & ~chunk->used) != 0;
+    mrb_bool best_warm;
+
+    if (chunk->used == GC_CHUNK_ALL_USED) continue;
+    best_warm = best && (best->resident & ~best->used) != 0;
+    if (!best || (warm && !best_warm) ||
+        (warm == best_warm && chunk_page_count(chunk->used) > chunk_page_count(best->used))) {
+      best = chunk;
+    }
+  }
+  if (!best) {
+    best = map_chunk(mrb);
+  }
+  avail = best->resident & ~best->used;
+  if (!avail) avail = ~best->used;
+  for (i = 0; !(avail & ((uint32_t)1 << i)); i++)
+    ;
+  best->used |= (uint32_t)1 << i;
+  best->resident |= (uint32_t)1 << i;
+  page = (struct heap_page*)(best->base + GC_PAGE_ALIGN * i);
+  memset(page, 0, sizeof(struct heap_page));
+  page->chunk = best;
+  mrb->heap_pages++;
+  return page;
+}
+
+static void
+gc_page_free(mrb_state *mrb, struct heap_page *page)
+{
+  struct heap_chunk *chunk = page->chunk;
+
+  chunk->used &= ~((uint32_t)1 << (((char*)page - chunk->base) / GC_PAGE_ALIGN));
+  mrb->heap_pages--;
+}
+
+/* release chunks without live pages beyond the free page reserve */
+static void
+gc_trim_chunks(mrb_state *mrb)
+{
+  struct heap_chunk *chunk;
+  size_t resident = 0;
+
+  for (chunk = mrb->heap_chunks; chunk; chunk = chunk->next) {
+    resident += chunk_page_count(chunk->resident & ~chunk->used);
+  }
+  for (chunk = mrb->heap_chunks; chunk && resident > mrb->gc_trim_threshold; chunk = chunk->next) {
+    if (chunk->used == 0 && chunk->resident != 0) {
+      madvise(chunk->base, GC_CHUNK_SIZE, MADV_DONTNEED);
+      resident -= chunk_page_count(chunk->resident);
+      chunk->resident = 0;
+    }
+  }
+}
+
 static void
-add_heap(mrb_state *mrb)
+gc_free_chunks(mrb_state *mrb)
 {
-  struct heap_page *page = (struct heap_page *)mrb_calloc(mrb, 1, sizeof(struct heap_page));
-  RVALUE *p, *e;
+  struct heap_chunk *chunk = mrb->heap_chunks, *next;
+
+  while (chunk) {
+    next = chunk->next;
+    munmap(chunk->base, GC_CHUNK_SIZE);
+    mrb_free(mrb, chunk);
+    chunk = next;
+  }
+  mrb->heap_chunks = NULL;
+}
+#else
+#define DEFAULT_GC_HUGE_PAGE_THRESHOLD 0
+#define DEFAULT_GC_TRIM_THRESHOLD 0
+
+static struct heap_page*
+gc_page_alloc(mrb_state *mrb)
+{
+  void *mem = gc_realloc(mrb, NULL, sizeof(struct heap_page) + GC_PAGE_ALIGN - 1);
+  struct heap_page *page;
+
+  /* the slack past the aligned page is never touched */
+  page = (struct heap_page *)(((uintptr_t)mem + GC_PAGE_ALIGN - 1) & ~(GC_PAGE_ALIGN - 1));
+  memset(page, 0, sizeof(struct heap_page));
+  page->mem = mem;
+  mrb->heap_pages++;
+  return page;
+}
+
+static void
+gc_page_free(mrb_state *mrb, struct heap_page *page)
+{
+  mrb_free(mrb, page->mem);
+  mrb->heap_pages--;
+}
+
+#define gc_trim_chunks(mrb) ((void)0)
+#define gc_free_chunks(mrb) ((void)0)
+#endif
+
+static void
+add_heap(mrb_state *mrb, enum gc_size_class size_class)
+{
+  struct heap_page *page = gc_page_alloc(mrb);
   struct RBasic *prev = NULL;
+  size_t i;
 
-  for (p = page->objects, e=p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
-    p->as.free.tt = MRB_TT_FREE;
-    p->as.free.next = prev;
-    prev = &p->as.basic;
+  page->size_class = (uint8_t)size_class;
+  page->slot_size = gc_slot_size[size_class];
+  page->slot_inv = (uint32_t)((((uint64_t)1 << 32) + page->slot_size - 1) / page->slot_size);
+  page->nslots = sizeof(page->objects) / page->slot_size;
+  for (i = 0; i < page->nslots; i++) {
+    struct free_obj *p = (struct free_obj*)page_slot(page, i);
+
+    p->tt = MRB_TT_FREE;
+    page->colors[i] = GC_FREE_SLOT;
+    p->next = prev;
+    prev = (struct RBasic*)p;
   }
   page->freelist = prev;
 
@@ -283,18 +645,29 @@ add_heap(mrb_state *mrb)
 #define DEFAULT_GC_INTERVAL_RATIO 200
 #define DEFAULT_GC_STEP_RATIO 200
 #define DEFAULT_MAJOR_GC_INC_RATIO 200
+#define DEFAULT_GC_MALLOC_RATIO 256
+#define malloc_slots(mrb, bytes) ((mrb)->gc_malloc_ratio > 0 ? (bytes)/(mrb)->gc_malloc_ratio : 0)
 #define is_generational(mrb) ((mrb)->is_generational_gc_mode)
 #define is_major_gc(mrb) (is_generational(mrb) && (mrb)->gc_full)
 #define is_minor_gc(mrb) (is_generational(mrb) && !(mrb)->gc_full)
+#ifdef MRB_GC_CONCURRENT_SWEEP
+#define gc_sweeping_in_background(mrb) ((mrb)->sweep_job != NULL)
+#else
+#define gc_sweeping_in_background(mrb) FALSE
+#endif
 
 void
 mrb_init_heap(mrb_state *mrb)
 {
   mrb->heaps = 0;
-  mrb->free_heaps = 0;
-  add_heap(mrb);
+  add_heap(mrb, GC_SLOT_LARGE);
   mrb->gc_interval_ratio = DEFAULT_GC_INTERVAL_RATIO;
   mrb->gc_step_ratio = DEFAULT_GC_STEP_RATIO;
+  mrb->gc_malloc_ratio = DEFAULT_GC_MALLOC_RATIO;
+  mrb->gc_step_chunk = GC_STEP_SIZE / 4;
+  mrb->gc_mark_workers = 1;
+  mrb->gc_huge_page_threshold = DEFAULT_GC_HUGE_PAGE_THRESHOLD;
+  mrb->gc_trim_threshold = DEFAULT_GC_TRIM_THRESHOLD;
   mrb->is_generational_gc_mode = TRUE;
   mrb->gc_full = TRUE;
 
@@ -304,23 +677,40 @@ mrb_init_heap(mrb_state *mrb)
 }
 
 static void obj_free(mrb_state *mrb, struct RBasic *obj);
+static void gray_stack_free(mrb_state *mrb, struct mrb_gray_stack *s);
+static size_t incremental_gc(mrb_state *mrb, size_t limit);
+static void incremental_gc_done(mrb_state *mrb);
+#ifdef MRB_GC_CONCURRENT_SWEEP
+static size_t concurrent_sweep_phase(mrb_state *mrb);
+#endif
 
 void
 mrb_free_heap(mrb_state *mrb)
 {
   struct heap_page *page = mrb->heaps;
   struct heap_page *tmp;
-  RVALUE *p, *e;
+  size_t i;
 
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  while (mrb->sweep_job) {
+    concurrent_sweep_phase(mrb);
+  }
+  page = mrb->heaps;
+#endif
   while (page) {
     tmp = page;
     page = page->next;
-    for (p = tmp->objects, e=p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
-      if (p->as.free.tt != MRB_TT_FREE)
-        obj_free(mrb, &p->as.basic);
+    for (i = 0; i < tmp->nslots; i++) {
+      struct RBasic *obj = page_slot(tmp, i);
+
+      if (obj->tt != MRB_TT_FREE)
+        obj_free(mrb, obj);
     }
-    mrb_free(mrb, tmp);
+    gc_page_free(mrb, tmp);
   }
+  gc_free_chunks(mrb);
+  gray_stack_free(mrb, &mrb->gray_stack);
+  gray_stack_free(mrb, &mrb->variable_gray_stack);
 }
 
 static void
@@ -341,39 +731,183 @@ mrb_gc_protect(mrb_state *mrb, mrb_value obj)
   gc_protect(mrb, mrb_basic_ptr(obj));
 }
 
+static uint64_t
+gc_clock_ns(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+  return (uint64_t)clock() * 1000000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+#define gc_clock_us() (gc_clock_ns() / 1000)
+
+/*
+  Statistics and events.  mrb->gc_stat counts cycles and the time
+  spent in each phase; mrb->gc_event_hook, when set, is called at each
+  phase transition.  The hook runs in the middle of a collection and
+  must not allocate objects.
+ */
+#define gc_event(mrb, ev) do {\
+  if ((mrb)->gc_event_hook) (mrb)->gc_event_hook((mrb), (ev), (mrb)->gc_event_ud);\
+} while (0)
+
+void
+mrb_gc_set_event_hook(mrb_state *mrb, mrb_gc_event_hook hook, void *ud)
+{
+  mrb->gc_event_hook = hook;
+  mrb->gc_event_ud = ud;
+}
+
+static void
+gc_cycle_start(mrb_state *mrb)
+{
+  struct mrb_gc_stat *st = &mrb->gc_stat;
+
+  st->count++;
+  if (is_minor_gc(mrb))
+    st->minor_count++;
+  else
+    st->major_count++;
+  st->latest_major = !is_minor_gc(mrb);
+  st->latest_full = FALSE;
+  st->latest_open = TRUE;
+  st->latest_live_after_mark = 0;
+  st->latest_freed = 0;
+  st->latest_mark_time_ns = 0;
+  st->latest_sweep_time_ns = 0;
+  st->latest_max_pause_ns = 0;
+  gc_event(mrb, MRB_GC_EVENT_START);
+}
+
+/* the sweep reached GC_STATE_NONE */
+static void
+gc_cycle_end(mrb_state *mrb)
+{
+  /* clear_all_old() sweeps outside of a cycle */
+  if (!mrb->gc_stat.latest_open) return;
+  mrb->gc_stat.latest_open = FALSE;
+  gc_event(mrb, MRB_GC_EVENT_END);
+}
+
+/* account a GC call that started at start as one pause */
+static void
+gc_pause_end(mrb_state *mrb, uint64_t start)
+{
+  uint64_t t = gc_clock_ns() - start;
+
+  if (t > mrb->gc_stat.max_pause_ns)
+    mrb->gc_stat.max_pause_ns = t;
+  if (t > mrb->gc_stat.latest_max_pause_ns)
+    mrb->gc_stat.latest_max_pause_ns = t;
+}
+
 struct RBasic*
 mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
 {
   struct RBasic *p;
-  static const RVALUE RVALUE_zero = { { { MRB_TT_FALSE } } };
+  enum gc_size_class size_class = gc_size_class(ttype);
+  struct heap_page *page;
 
 #ifdef MRB_GC_STRESS
   mrb_garbage_collect(mrb);
 #endif
-  if (mrb->gc_threshold < mrb->live) {
+  if (mrb->gc_threshold < mrb->live + malloc_slots(mrb, mrb->malloc_increase)) {
     mrb_incremental_gc(mrb);
   }
-  if (mrb->free_heaps == NULL) {
-    add_heap(mrb);
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  /* outrunning the sweeper; sweep here until a page has room */
+  if (mrb->free_heaps[size_class] == NULL && mrb->sweep_job) {
+    uint64_t start = gc_clock_ns();
+
+    while (mrb->free_heaps[size_class] == NULL && mrb->sweep_job) {
+      incremental_gc(mrb, GC_STEP_SIZE);
+      if (mrb->gc_state == GC_STATE_NONE) {
+        incremental_gc_done(mrb);
+      }
+    }
+    gc_pause_end(mrb, start);
+  }
+#endif
+  if (mrb->free_heaps[size_class] == NULL) {
+    add_heap(mrb, size_class);
   }
 
-  p = mrb->free_heaps->freelist;
-  mrb->free_heaps->freelist = ((struct free_obj*)p)->next;
-  if (mrb->free_heaps->freelist == NULL) {
-    unlink_free_heap_page(mrb, mrb->free_heaps);
+  page = mrb->free_heaps[size_class];
+  p = page->freelist;
+  page->freelist = ((struct free_obj*)p)->next;
+  if (page->freelist == NULL) {
+    unlink_free_heap_page(mrb, page);
   }
 
   mrb->live++;
+  mrb->gc_stat.total_allocated_objects++;
   gc_protect(mrb, p);
-  *(RVALUE *)p = RVALUE_zero;
+  memset(p, 0, page->slot_size);
   p->tt = ttype;
   p->c = cls;
   paint_partial_white(mrb, p);
   return p;
 }
 
+/*
+  Gray objects wait on mrb->gray_stack (and mrb->variable_gray_stack,
+  filled by mrb_write_barrier and traversed in final marking).  The
+  stacks grow through allocf directly, since mrb_realloc may start a
+  GC.  When growing fails the object stays gray but off the stack and
+  gray_overflow is set; once the stack drains, the heap is rescanned
+  for gray objects.
+ */
+#define GC_GRAY_STACK_INIT 1024
+#define GC_PREFETCH_DISTANCE 4
+#ifdef __GNUC__
+#define gc_prefetch(p) __builtin_prefetch(p)
+#else
+#define gc_prefetch(p) ((void)0)
+#endif
+
+static void
+gray_push(mrb_state *mrb, struct mrb_gray_stack *s, struct RBasic *obj)
+{
+  if (s->len == s->capa) {
+    size_t capa = s->capa ? s->capa * 2 : GC_GRAY_STACK_INIT;
+    struct RBasic **objs = (struct RBasic**)(mrb->allocf)(mrb, s->objs, sizeof(struct RBasic*) * capa, mrb->ud);
+
+    if (!objs) {
+      mrb->gray_overflow = TRUE;
+      return;
+    }
+    s->objs = objs;
+    s->capa = capa;
+  }
+  s->objs[s->len++] = obj;
+}
+
+static inline struct RBasic*
+gray_pop(struct mrb_gray_stack *s)
+{
+  struct RBasic *obj = s->objs[--s->len];
+
+  if (s->len >= GC_PREFETCH_DISTANCE) {
+    gc_prefetch(s->objs[s->len - GC_PREFETCH_DISTANCE]);
+  }
+  return obj;
+}
+
+static void
+gray_stack_free(mrb_state *mrb, struct mrb_gray_stack *s)
+{
+  (mrb->allocf)(mrb, s->objs, 0, mrb->ud);
+  s->objs = NULL;
+  s->len = s->capa = 0;
+}
+
 static inline void
-add_gray_list(mrb_state *mrb, struct RBasic *obj)
+add_gray(mrb_state *mrb, struct RBasic *obj)
 {
 #ifdef MRB_GC_STRESS
   if (obj->tt > MRB_TT_MAXDEFINE) {
@@ -381,16 +915,41 @@ add_gray_list(mrb_state *mrb, struct RBasic *obj)
   }
 #endif
   paint_gray(obj);
-  obj->gcnext = mrb->gray_list;
-  mrb->gray_list = obj;
+  gray_push(mrb, &mrb->gray_stack, obj);
 }
 
+/* push gray objects dropped by a failed stack growth */
 static void
-gc_mark_children(mrb_state *mrb, struct RBasic *obj)
+gc_rescan_gray(mrb_state *mrb)
+{
+  struct heap_page *page;
+  size_t i;
+
+  mrb->gray_overflow = FALSE;
+  for (page = mrb->heaps; page; page = page->next) {
+    for (i = 0; i < page->nslots; i++) {
+      struct RBasic *obj = page_slot(page, i);
+
+      if (obj->tt != MRB_TT_FREE && page->colors[i] == MRB_GC_GRAY) {
+        gray_push(mrb, &mrb->gray_stack, obj);
+      }
+    }
+  }
+}
+
+/* TRUE while gray objects remain to be traversed */
+static mrb_bool
+gc_gray_pending(mrb_state *mrb)
+{
+  if (mrb->gray_stack.len == 0 && mrb->gray_overflow) {
+    gc_rescan_gray(mrb);
+  }
+  return mrb->gray_stack.len > 0;
+}
+
+static void
+mark_children(mrb_state *mrb, struct RBasic *obj)
 {
-  gc_assert(is_gray(obj));
-  paint_black(obj);
-  mrb->gray_list = obj->gcnext;
   mrb_gc_mark(mrb, (struct RBasic*)obj->c);
   switch (obj->tt) {
   case MRB_TT_ICLASS:
@@ -472,13 +1031,239 @@ gc_mark_children(mrb_state *mrb, struct RBasic *obj)
   }
 }
 
+static void
+gc_mark_children(mrb_state *mrb, struct RBasic *obj)
+{
+  gc_assert(is_gray(obj));
+  paint_black(obj);
+  mark_children(mrb, obj);
+}
+
+/* traverse every gray object on the gray stack */
+static void
+gc_drain_gray(mrb_state *mrb)
+{
+  while (gc_gray_pending(mrb)) {
+    struct RBasic *obj = gray_pop(&mrb->gray_stack);
+
+    if (is_gray(obj))
+      gc_mark_children(mrb, obj);
+  }
+}
+
+#ifdef MRB_GC_PARALLEL_MARK
+/*
+  Parallel marking for stop-the-world full GC.
+
+  The gray stacks left by the root scan are split among
+  mrb->gc_mark_workers markers (the calling thread is marker 0).
+  A marker claims a white object by compare-and-swap on its color
+  byte, pushes it on its own bounded stack and steals half of another
+  marker's stack when its own runs dry.  Markers must not allocate, so
+  the stacks are allocated up front; an object that does not fit stays
+  gray and is found by the rescan after the markers finish.
+ */
+#define GC_MARK_STACK_SIZE 4096
+#define GC_MARK_WORKERS_MAX 64
+
+struct gc_marker {
+  struct gc_parallel *par;
+  pthread_mutex_t lock;
+  struct RBasic **stack;
+  size_t len;
+};
+
+struct gc_parallel {
+  mrb_state *mrb;
+  struct gc_marker *markers;
+  int n;
+  int idle;
+  int overflow;                 /* some gray object was not pushed */
+};
+
+static __thread struct gc_marker *gc_current_marker;
+
+static void
+marker_push(struct gc_marker *m, struct RBasic *obj)
+{
+  pthread_mutex_lock(&m->lock);
+  if (m->len < GC_MARK_STACK_SIZE) {
+    m->stack[m->len++] = obj;
+    pthread_mutex_unlock(&m->lock);
+    return;
+  }
+  pthread_mutex_unlock(&m->lock);
+  __atomic_store_n(&m->par->overflow, TRUE, __ATOMIC_RELAXED);
+}
+
+static void
+parallel_mark(struct gc_marker *m, struct RBasic *obj)
+{
+  uint8_t *cp = &gc_color_ref(obj);
+  uint8_t c = __atomic_load_n(cp, __ATOMIC_RELAXED);
+
+  do {
+    if (!(c & MRB_GC_WHITES)) return;
+  } while (!__atomic_compare_exchange_n(cp, &c, MRB_GC_GRAY, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  marker_push(m, obj);
+}
+
+static struct RBasic*
+marker_pop(struct gc_marker *m)
+{
+  struct gc_parallel *par = m->par;
+  struct RBasic *obj = NULL;
+  int i;
+
+  pthread_mutex_lock(&m->lock);
+  if (m->len > 0) {
+    obj = m->stack[--m->len];
+    if (m->len >= GC_PREFETCH_DISTANCE) {
+      gc_prefetch(m->stack[m->len - GC_PREFETCH_DISTANCE]);
+    }
+  }
+  pthread_mutex_unlock(&m->lock);
+  if (obj) return obj;
+
+  /* steal half of the first non-empty stack */
+  for (i = 0; i < par->n && !obj; i++) {
+    struct gc_marker *v = &par->markers[i];
+    struct RBasic *buf[GC_MARK_STACK_SIZE / 2];
+    size_t half = 0, j;
+
+    if (v == m || __atomic_load_n(&v->len, __ATOMIC_RELAXED) == 0) continue;
+    pthread_mutex_lock(&v->lock);
+    if (v->len > 0) {
+      half = (v->len + 1) / 2;
+      v->len -= half;
+      memcpy(buf, v->stack + v->len, sizeof(struct RBasic*) * half);
+    }
+    pthread_mutex_unlock(&v->lock);
+    if (half == 0) continue;
+    obj = buf[--half];
+    pthread_mutex_lock(&m->lock);
+    for (j = 0; j < half; j++) {
+      m->stack[m->len++] = buf[j];
+    }
+    pthread_mutex_unlock(&m->lock);
+  }
+  return obj;
+}
+
+static int
+parallel_has_work(struct gc_parallel *par)
+{
+  int i;
+
+  for (i = 0; i < par->n; i++) {
+    if (__atomic_load_n(&par->markers[i].len, __ATOMIC_ACQUIRE) > 0) return TRUE;
+  }
+  return FALSE;
+}
+
+static void*
+parallel_mark_worker(void *arg)
+{
+  struct gc_marker *m = (struct gc_marker*)arg;
+  struct gc_parallel *par = m->par;
+  struct RBasic *obj;
+
+  gc_current_marker = m;
+  for (;;) {
+    while ((obj = marker_pop(m)) != NULL) {
+      __atomic_store_n(&gc_color_ref(obj), MRB_GC_BLACK, __ATOMIC_RELAXED);
+      mark_children(par->mrb, obj);
+    }
+    /* no one but busy markers can create work; all idle means done */
+    __atomic_add_fetch(&par->idle, 1, __ATOMIC_ACQ_REL);
+    for (;;) {
+      if (__atomic_load_n(&par->idle, __ATOMIC_ACQUIRE) == par->n) {
+        gc_current_marker = NULL;
+        return NULL;
+      }
+      if (parallel_has_work(par)) break;
+      sched_yield();
+    }
+    __atomic_sub_fetch(&par->idle, 1, __ATOMIC_ACQ_REL);
+  }
+}
+
+static void
+gc_parallel_mark(mrb_state *mrb)
+{
+  struct gc_parallel par;
+  pthread_t threads[GC_MARK_WORKERS_MAX];
+  struct mrb_gray_stack *seeds[2];
+  struct RBasic *obj;
+  size_t j;
+  int i, n = mrb->gc_mark_workers, started;
+
+  if (n > GC_MARK_WORKERS_MAX) n = GC_MARK_WORKERS_MAX;
+  par.mrb = mrb;
+  par.n = n;
+  par.idle = 0;
+  par.overflow = FALSE;
+  par.markers = (struct gc_marker*)mrb_malloc(mrb, sizeof(struct gc_marker) * n);
+  for (i = 0; i < n; i++) {
+    par.markers[i].par = &par;
+    par.markers[i].len = 0;
+    par.markers[i].stack = (struct RBasic**)mrb_malloc(mrb, sizeof(struct RBasic*) * GC_MARK_STACK_SIZE);
+    pthread_mutex_init(&par.markers[i].lock, NULL);
+  }
+
+  /* seed markers round robin with the gray objects */
+  seeds[0] = &mrb->gray_stack;
+  seeds[1] = &mrb->variable_gray_stack;
+  for (i = 0, started = 0; i < 2; i++) {
+    for (j = 0; j < seeds[i]->len; j++) {
+      obj = seeds[i]->objs[j];
+      if (is_gray(obj)) {
+        marker_push(&par.markers[started++ % n], obj);
+      }
+    }
+    seeds[i]->len = 0;
+  }
+
+  for (started = 1; started < n; started++) {
+    if (pthread_create(&threads[started], NULL, parallel_mark_worker, &par.markers[started]) != 0)
+      break;
+  }
+  par.n = started;
+  parallel_mark_worker(&par.markers[0]);
+  for (i = 1; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  /* seeds of markers whose thread could not be started go back to gray */
+  for (i = started; i < n; i++) {
+    while (par.markers[i].len > 0) {
+      gray_push(mrb, &mrb->gray_stack, par.markers[i].stack[--par.markers[i].len]);
+    }
+  }
+  if (par.overflow) {
+    mrb->gray_overflow = TRUE;
+  }
+
+  for (i = 0; i < n; i++) {
+    pthread_mutex_destroy(&par.markers[i].lock);
+    mrb_free(mrb, par.markers[i].stack);
+  }
+  mrb_free(mrb, par.markers);
+}
+#endif
+
 void
 mrb_gc_mark(mrb_state *mrb, struct RBasic *obj)
 {
   if (obj == 0) return;
+#ifdef MRB_GC_PARALLEL_MARK
+  if (gc_current_marker) {
+    parallel_mark(gc_current_marker, obj);
+    return;
+  }
+#endif
   if (!is_white(obj)) return;
   gc_assert((obj)->tt != MRB_TT_FREE);
-  add_gray_list(mrb, obj);
+  add_gray(mrb, obj);
 }
 
 static void
@@ -502,6 +1287,7 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
   case MRB_TT_MODULE:
   case MRB_TT_SCLASS:
     mrb_gc_free_mt(mrb, (struct RClass*)obj);
+    mrb_gc_free_display(mrb, (struct RClass*)obj);
     mrb_gc_free_iv(mrb, (struct RObject*)obj);
     break;
 
@@ -536,6 +1322,15 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
     mrb_free(mrb, ((struct RRange*)obj)->edges);
     break;
 
+  case MRB_TT_PROC:
+    {
+      struct RProc *p = (struct RProc*)obj;
+
+      if (!MRB_PROC_CFUNC_P(p) && p->body.irep)
+        mrb_irep_decref(mrb, p->body.irep);
+    }
+    break;
+
   case MRB_TT_DATA:
     {
       struct RData *d = (struct RData*)obj;
@@ -550,19 +1345,20 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
     break;
   }
   obj->tt = MRB_TT_FREE;
+  gc_paint(obj, GC_FREE_SLOT);
 }
 
 static void
 root_scan_phase(mrb_state *mrb)
 {
-  int j;
   size_t i;
   size_t e;
   mrb_callinfo *ci;
 
   if (!is_minor_gc(mrb)) {
-    mrb->gray_list = 0;
-    mrb->variable_gray_list = 0;
+    mrb->gray_stack.len = 0;
+    mrb->variable_gray_stack.len = 0;
+    mrb->gray_overflow = FALSE;
   }
 
   mrb_gc_mark_gv(mrb);
@@ -595,18 +1391,6 @@ root_scan_phase(mrb_state *mrb)
     mrb_gc_mark(mrb, (struct RBasic*)ci->proc);
     mrb_gc_mark(mrb, (struct RBasic*)ci->target_class);
   }
-  /* mark irep pool */
-  if (mrb->irep) {
-    size_t len = mrb->irep_len;
-    if (len > mrb->irep_capa) len = mrb->irep_capa;
-    for (i=0; i<len; i++) {
-      mrb_irep *irep = mrb->irep[i];
-      if (!irep) continue;
-      for (j=0; j<irep->plen; j++) {
-        mrb_gc_mark_value(mrb, irep->pool[j]);
-      }
-    }
-  }
 }
 
 static size_t
@@ -670,127 +1454,454 @@ incremental_marking_phase(mrb_state *mrb, size_t limit)
 {
   size_t tried_marks = 0;
 
-  while (mrb->gray_list && tried_marks < limit) {
-    tried_marks += gc_gray_mark(mrb, mrb->gray_list);
+  while (tried_marks < limit && gc_gray_pending(mrb)) {
+    struct RBasic *obj = gray_pop(&mrb->gray_stack);
+
+    if (is_gray(obj))
+      tried_marks += gc_gray_mark(mrb, obj);
   }
 
   return tried_marks;
 }
 
+/*
+  Pool literals never change once stored, so after a generational
+  cycle they are all old.  Minor GCs only mark the pools from
+  mrb->irep_old_len on; storing into a pool below it must go through
+  mrb_irep_pool_barrier().  Pools are marked in the atomic final
+  marking so that literals stored during the cycle are not missed.
+ */
 static void
-final_marking_phase(mrb_state *mrb)
+mark_irep_pools(mrb_state *mrb)
 {
-  while (mrb->gray_list) {
-    if (is_gray(mrb->gray_list))
-      gc_mark_children(mrb, mrb->gray_list);
-    else
-      mrb->gray_list = mrb->gray_list->gcnext;
-  }
-  gc_assert(mrb->gray_list == NULL);
-  mrb->gray_list = mrb->variable_gray_list;
-  mrb->variable_gray_list = 0;
-  while (mrb->gray_list) {
-    if (is_gray(mrb->gray_list))
-      gc_mark_children(mrb, mrb->gray_list);
-    else
-      mrb->gray_list = mrb->gray_list->gcnext;
+  size_t i, j;
+  size_t len = mrb->irep_len;
+
+  if (!mrb->irep) return;
+  if (len > mrb->irep_capa) len = mrb->irep_capa;
+  for (i = is_minor_gc(mrb) ? mrb->irep_old_len : 0; i<len; i++) {
+    mrb_irep *irep = mrb->irep[i];
+    if (!irep) continue;
+    for (j=0; j<irep->plen; j++) {
+      mrb_gc_mark_value(mrb, irep->pool[j]);
+    }
+  }
+  mrb->irep_old_len = is_generational(mrb) ? len : 0;
+}
+
+void
+mrb_irep_pool_barrier(mrb_state *mrb, mrb_irep *irep)
+{
+  if (irep->idx < mrb->irep_old_len) {
+    mrb->irep_old_len = irep->idx;
   }
-  gc_assert(mrb->gray_list == NULL);
 }
 
+static void
+final_marking_phase(mrb_state *mrb)
+{
+  struct mrb_gray_stack s;
+
+  mark_irep_pools(mrb);
+  gc_drain_gray(mrb);
+  /* the gray stack is empty; reuse its buffer for the variable stack */
+  s = mrb->gray_stack;
+  mrb->gray_stack = mrb->variable_gray_stack;
+  mrb->variable_gray_stack = s;
+  gc_drain_gray(mrb);
+  gc_assert(mrb->gray_stack.len == 0);
+}
+
+#ifdef MRB_GC_CONCURRENT_SWEEP
+static void concurrent_sweep_start(mrb_state *mrb);
+#endif
+
 static void
 prepare_incremental_sweep(mrb_state *mrb)
 {
   mrb->gc_state = GC_STATE_SWEEP;
   mrb->sweeps = mrb->heaps;
   mrb->gc_live_after_mark = mrb->live;
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  if (mrb->gc_concurrent_sweep) {
+    concurrent_sweep_start(mrb);
+  }
+#endif
+}
+
+/* hand a swept page back to the allocator, or free it when all dead */
+static void
+sweep_page_done(mrb_state *mrb, struct heap_page *page, size_t freed, int dead_slot, mrb_bool linked)
+{
+  if (dead_slot && freed < page->nslots) {
+    unlink_heap_page(mrb, page);
+    unlink_free_heap_page(mrb, page);
+    gc_page_free(mrb, page);
+  }
+  else {
+    if (!linked && page->freelist) {
+      link_free_heap_page(mrb, page);
+    }
+    if (page->freelist == NULL && is_minor_gc(mrb))
+      page->old = TRUE;
+    else
+      page->old = FALSE;
+  }
+  mrb->live -= freed;
+  mrb->gc_live_after_mark -= freed;
+  mrb->gc_stat.total_freed_objects += freed;
+  mrb->gc_stat.latest_freed += freed;
 }
 
 static size_t
 incremental_sweep_phase(mrb_state *mrb, size_t limit)
 {
-  struct heap_page *page = mrb->sweeps;
+  struct heap_page *page = mrb->sweeps, *next;
   size_t tried_sweep = 0;
+  uint8_t dead = other_white_part(mrb) & MRB_GC_WHITES;
 
   while (page && (tried_sweep < limit)) {
-    RVALUE *p = page->objects;
-    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
+    size_t i, n = page->nslots;
     size_t freed = 0;
     int dead_slot = 1;
     int full = (page->freelist == NULL);
 
+    tried_sweep += n;
     if (is_minor_gc(mrb) && page->old) {
       /* skip a slot which doesn't contain any young object */
-      p = e;
+      n = 0;
       dead_slot = 0;
     }
-    while (p<e) {
-      if (is_dead(mrb, &p->as.basic)) {
-        if (p->as.basic.tt != MRB_TT_FREE) {
-          obj_free(mrb, &p->as.basic);
-          p->as.free.next = page->freelist;
-          page->freelist = (struct RBasic*)p;
+    for (i = 0; i < n; i++) {
+      struct RBasic *obj = page_slot(page, i);
+
+      if (obj->tt == MRB_TT_FREE || (page->colors[i] & dead)) {
+        if (obj->tt != MRB_TT_FREE) {
+          obj_free(mrb, obj);
+          ((struct free_obj*)obj)->next = page->freelist;
+          page->freelist = obj;
           freed++;
         }
       }
       else {
         if (!is_generational(mrb))
-          paint_partial_white(mrb, &p->as.basic); /* next gc target */
+          page->colors[i] = (uint8_t)mrb->current_white_part; /* next gc target */
         dead_slot = 0;
       }
-      p++;
     }
 
-    /* free dead slot */
-    if (dead_slot && freed < MRB_HEAP_PAGE_SIZE) {
-      struct heap_page *next = page->next;
+    next = page->next;
+    sweep_page_done(mrb, page, freed, dead_slot, !full);
+    page = next;
+  }
+  mrb->sweeps = page;
+  return tried_sweep;
+}
+
+#ifdef MRB_GC_CONCURRENT_SWEEP
+/*
+  Concurrent sweep.
+
+  When marking ends, every heap page is queued on a gc_sweep_job and
+  leaves the allocator's free list.  A helper thread claims pages in
+  order and frees dead objects whose obj_free only releases buffers
+  (mrb->allocf must be thread safe).  Objects whose freeing touches
+  interpreter state (classes, DATA, shared strings and arrays) are left
+  for the mutator to free.  The mutator finalizes swept pages as it
+  steps the GC, and sweeps pages itself when it runs out of free slots
+  before the helper catches up.  It is off until GC.concurrent_sweep is
+  set.
+ */
+
+enum {
+  PAGE_SWEEP_NONE,              /* finalized, owned by the allocator */
+  PAGE_SWEEP_PENDING,           /* queued or being swept */
+  PAGE_SWEEP_SWEPT,             /* swept, waiting for finalization */
+};
+
+struct gc_sweep_job {
+  mrb_state *mrb;
+  pthread_t thread;
+  mrb_bool threaded;
+  struct gc_sweep_job *next_job; /* in sweep_jobs while threaded */
+  mrb_bool minor;
+  mrb_bool generational;
+  uint8_t current_white;
+  struct heap_page **pages;
+  size_t len;
+  size_t next;                  /* next page to claim */
+  size_t done;                  /* pages before this are finalized */
+};
+
+static mrb_bool
+sweep_local_p(struct RBasic *obj)
+{
+  switch (obj->tt) {
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+  case MRB_TT_DATA:
+    return FALSE;
+  case MRB_TT_ARRAY:
+    return !(obj->flags & MRB_ARY_SHARED);
+  case MRB_TT_STRING:
+    return !(obj->flags & MRB_STR_SHARED);
+  case MRB_TT_PROC:
+    /* dropping the last reference to a unit frees its ireps */
+    return MRB_PROC_CFUNC_P((struct RProc*)obj);
+  default:
+    return TRUE;
+  }
+}
 
-      unlink_heap_page(mrb, page);
-      unlink_free_heap_page(mrb, page);
-      mrb_free(mrb, page);
-      page = next;
+static void
+sweep_page(struct gc_sweep_job *job, struct heap_page *page, mrb_bool local_only)
+{
+  mrb_state *mrb = job->mrb;
+  uint8_t dead = job->current_white ^ MRB_GC_WHITES;
+  size_t i, n = page->nslots;
+  size_t freed = 0;
+  int dead_slot = 1;
+
+  page->swept_deferred = 0;
+  if (job->minor && page->old) {
+    n = 0;
+    dead_slot = 0;
+  }
+  for (i = 0; i < n; i++) {
+    struct RBasic *obj = page_slot(page, i);
+    uint8_t *cp = &page->colors[i];
+    uint8_t color = __atomic_load_n(cp, __ATOMIC_RELAXED);
+
+    /* only dead objects are read; live ones belong to the mutator */
+    if (color & GC_FREE_SLOT) continue;
+    if (color & dead) {
+      if (!local_only || sweep_local_p(obj)) {
+        obj_free(mrb, obj);
+        ((struct free_obj*)obj)->next = page->freelist;
+        page->freelist = obj;
+        freed++;
+      }
+      else {
+        page->swept_deferred++;
+      }
     }
     else {
-      if (full && freed > 0) {
-        link_free_heap_page(mrb, page);
-      }
-      if (page->freelist == NULL && is_minor_gc(mrb))
-        page->old = TRUE;
-      else
-        page->old = FALSE;
-      page = page->next;
+      if (!job->generational)
+        __atomic_store_n(cp, job->current_white, __ATOMIC_RELAXED);
+      dead_slot = 0;
     }
-    tried_sweep += MRB_HEAP_PAGE_SIZE;
-    mrb->live -= freed;
-    mrb->gc_live_after_mark -= freed;
   }
-  mrb->sweeps = page;
-  return tried_sweep;
+  page->swept_freed = freed;
+  page->swept_dead = dead_slot;
+  __atomic_store_n(&page->sweep_state, PAGE_SWEEP_SWEPT, __ATOMIC_RELEASE);
 }
 
 static size_t
-incremental_gc(mrb_state *mrb, size_t limit)
+sweep_claim(struct gc_sweep_job *job)
+{
+  return __atomic_fetch_add(&job->next, 1, __ATOMIC_ACQ_REL);
+}
+
+static void*
+sweep_worker(void *arg)
+{
+  struct gc_sweep_job *job = (struct gc_sweep_job*)arg;
+  size_t i;
+
+  while ((i = sweep_claim(job)) < job->len) {
+    sweep_page(job, job->pages[i], TRUE);
+  }
+  return NULL;
+}
+
+/*
+  A child forked while a helper runs would wait forever for the pages
+  the helper had claimed.  Helpers are joined before fork() instead.
+ */
+static pthread_mutex_t sweep_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct gc_sweep_job *sweep_jobs;
+static pthread_once_t sweep_atfork_once = PTHREAD_ONCE_INIT;
+
+static void
+sweep_atfork_prepare(void)
+{
+  struct gc_sweep_job *job;
+
+  pthread_mutex_lock(&sweep_jobs_lock);
+  for (job = sweep_jobs; job; job = job->next_job) {
+    pthread_join(job->thread, NULL);
+    job->threaded = FALSE;
+  }
+  sweep_jobs = NULL;
+}
+
+static void
+sweep_atfork_release(void)
+{
+  pthread_mutex_unlock(&sweep_jobs_lock);
+}
+
+static void
+sweep_atfork_init(void)
+{
+  pthread_atfork(sweep_atfork_prepare, sweep_atfork_release, sweep_atfork_release);
+}
+
+static void
+sweep_page_finalize(mrb_state *mrb, struct gc_sweep_job *job, struct heap_page *page)
+{
+  uint8_t dead = job->current_white ^ MRB_GC_WHITES;
+  size_t freed = page->swept_freed;
+  size_t i;
+
+  /* dead objects still holding a type are the deferred ones */
+  for (i = 0; page->swept_deferred > 0 && i < page->nslots; i++) {
+    struct RBasic *obj = page_slot(page, i);
+
+    if (obj->tt != MRB_TT_FREE && (page->colors[i] & dead)) {
+      obj_free(mrb, obj);
+      ((struct free_obj*)obj)->next = page->freelist;
+      page->freelist = obj;
+      page->swept_deferred--;
+      freed++;
+    }
+  }
+  page->sweep_state = PAGE_SWEEP_NONE;
+  sweep_page_done(mrb, page, freed, page->swept_dead, FALSE);
+}
+
+static void
+concurrent_sweep_start(mrb_state *mrb)
+{
+  struct gc_sweep_job *job;
+  struct heap_page *page;
+  size_t n = 0;
+
+  for (page = mrb->heaps; page; page = page->next) n++;
+  /* not mrb_malloc: failing here must not recurse into the GC */
+  job = (struct gc_sweep_job*)(mrb->allocf)(mrb, NULL, sizeof(struct gc_sweep_job) + sizeof(struct heap_page*) * n, mrb->ud);
+  if (!job) return;             /* sweep on the mutator */
+
+  job->mrb = mrb;
+  job->minor = is_minor_gc(mrb);
+  job->generational = is_generational(mrb);
+  job->current_white = (uint8_t)mrb->current_white_part;
+  job->pages = (struct heap_page**)(job + 1);
+  job->len = n;
+  job->next = 0;
+  job->done = 0;
+  for (page = mrb->heaps, n = 0; page; page = page->next) {
+    page->sweep_state = PAGE_SWEEP_PENDING;
+    page->free_next = page->free_prev = NULL;
+    job->pages[n++] = page;
+  }
+  memset(mrb->free_heaps, 0, sizeof(mrb->free_heaps));
+  mrb->sweeps = NULL;
+  mrb->sweep_job = job;
+  pthread_once(&sweep_atfork_once, sweep_atfork_init);
+  pthread_mutex_lock(&sweep_jobs_lock);
+  job->threaded = pthread_create(&job->thread, NULL, sweep_worker, job) == 0;
+  if (job->threaded) {
+    job->next_job = sweep_jobs;
+    sweep_jobs = job;
+  }
+  pthread_mutex_unlock(&sweep_jobs_lock);
+}
+
+/* finalize swept pages in order; returns TRUE when the job is complete */
+static mrb_bool
+concurrent_sweep_collect(mrb_state *mrb)
+{
+  struct gc_sweep_job *job = mrb->sweep_job;
+
+  while (job->done < job->len) {
+    struct heap_page *page = job->pages[job->done];
+
+    /* NULL: finalized out of order by the mutator (and maybe freed) */
+    if (page) {
+      if (__atomic_load_n(&page->sweep_state, __ATOMIC_ACQUIRE) != PAGE_SWEEP_SWEPT)
+        return FALSE;
+      sweep_page_finalize(mrb, job, page);
+    }
+    job->done++;
+  }
+  pthread_mutex_lock(&sweep_jobs_lock);
+  if (job->threaded) {
+    struct gc_sweep_job **jp = &sweep_jobs;
+
+    while (*jp != job) jp = &(*jp)->next_job;
+    *jp = job->next_job;
+    pthread_join(job->thread, NULL);
+    job->threaded = FALSE;
+  }
+  pthread_mutex_unlock(&sweep_jobs_lock);
+  mrb->sweep_job = NULL;
+  mrb->gc_state = GC_STATE_NONE;
+  (mrb->allocf)(mrb, job, 0, mrb->ud);
+  gc_cycle_end(mrb);
+  return TRUE;
+}
+
+static size_t
+concurrent_sweep_phase(mrb_state *mrb)
+{
+  struct gc_sweep_job *job = mrb->sweep_job;
+  size_t done = job->done;
+  size_t i;
+
+  if (concurrent_sweep_collect(mrb)) return 0;
+  if (job->done > done) {
+    return (job->done - done) * MRB_HEAP_PAGE_SIZE;
+  }
+  /* nothing ready; sweep a page here rather than wait */
+  i = sweep_claim(job);
+  if (i < job->len) {
+    struct heap_page *page = job->pages[i];
+
+    job->pages[i] = NULL;
+    sweep_page(job, page, FALSE);
+    sweep_page_finalize(mrb, job, page);
+    return MRB_HEAP_PAGE_SIZE;
+  }
+  sched_yield();
+  return 1;
+}
+#endif
+
+static size_t
+incremental_gc_phase(mrb_state *mrb, size_t limit)
 {
   switch (mrb->gc_state) {
   case GC_STATE_NONE:
+    gc_cycle_start(mrb);
     root_scan_phase(mrb);
     mrb->gc_state = GC_STATE_MARK;
     flip_white_part(mrb);
     return 0;
   case GC_STATE_MARK:
-    if (mrb->gray_list) {
+    if (gc_gray_pending(mrb)) {
       return incremental_marking_phase(mrb, limit);
     }
     else {
       final_marking_phase(mrb);
+      mrb->gc_stat.latest_live_after_mark = mrb->live;
+      gc_event(mrb, MRB_GC_EVENT_MARK_END);
       prepare_incremental_sweep(mrb);
       return 0;
     }
   case GC_STATE_SWEEP: {
      size_t tried_sweep = 0;
+#ifdef MRB_GC_CONCURRENT_SWEEP
+     if (mrb->sweep_job) {
+       return concurrent_sweep_phase(mrb);
+     }
+#endif
      tried_sweep = incremental_sweep_phase(mrb, limit);
-     if (tried_sweep == 0)
+     if (tried_sweep == 0) {
        mrb->gc_state = GC_STATE_NONE;
+       gc_cycle_end(mrb);
+     }
      return tried_sweep;
   }
   default:
@@ -800,6 +1911,26 @@ incremental_gc(mrb_state *mrb, size_t limit)
   }
 }
 
+static size_t
+incremental_gc(mrb_state *mrb, size_t limit)
+{
+  struct mrb_gc_stat *st = &mrb->gc_stat;
+  enum gc_state state = mrb->gc_state;
+  uint64_t start = gc_clock_ns();
+  size_t result = incremental_gc_phase(mrb, limit);
+  uint64_t t = gc_clock_ns() - start;
+
+  if (state == GC_STATE_SWEEP) {
+    st->sweep_time_ns += t;
+    st->latest_sweep_time_ns += t;
+  }
+  else {
+    st->mark_time_ns += t;
+    st->latest_mark_time_ns += t;
+  }
+  return result;
+}
+
 static void
 advance_phase(mrb_state *mrb, enum gc_state to_state)
 {
@@ -809,66 +1940,121 @@ advance_phase(mrb_state *mrb, enum gc_state to_state)
 }
 
 static void
-clear_all_old(mrb_state *mrb)
+clear_all_old(mrb_state *mrb)
+{
+  size_t origin_mode = mrb->is_generational_gc_mode;
+
+  gc_assert(is_generational(mrb));
+  if (is_major_gc(mrb) || gc_sweeping_in_background(mrb)) {
+    advance_phase(mrb, GC_STATE_NONE);
+  }
+
+  mrb->is_generational_gc_mode = FALSE;
+  prepare_incremental_sweep(mrb);
+  advance_phase(mrb, GC_STATE_NONE);
+  mrb->variable_gray_stack.len = mrb->gray_stack.len = 0;
+  mrb->gray_overflow = FALSE;
+  mrb->is_generational_gc_mode = origin_mode;
+}
+
+#define GC_STEP_CHUNK_MIN 64
+
+static void
+incremental_gc_budget(mrb_state *mrb, uint64_t budget)
+{
+  uint64_t start = gc_clock_us();
+  uint64_t elapsed;
+  size_t chunk = mrb->gc_step_chunk;
+  size_t done = 0;
+
+  for (;;) {
+    done += incremental_gc(mrb, chunk);
+    elapsed = gc_clock_us() - start;
+    if (mrb->gc_state == GC_STATE_NONE || gc_sweeping_in_background(mrb) || elapsed >= budget)
+      break;
+  }
+
+  /* aim at about four clock checks per step at the measured rate */
+  if (elapsed > 0 && done > 0) {
+    chunk = (size_t)(done * budget / elapsed / 4);
+  }
+  else {
+    chunk *= 2;
+  }
+  if (chunk < GC_STEP_CHUNK_MIN) chunk = GC_STEP_CHUNK_MIN;
+  if (chunk > GC_STEP_SIZE * 64) chunk = GC_STEP_SIZE * 64;
+  mrb->gc_step_chunk = chunk;
+}
+
+/* set up the next cycle once an incremental cycle reached GC_STATE_NONE */
+static void
+incremental_gc_done(mrb_state *mrb)
 {
-  size_t origin_mode = mrb->is_generational_gc_mode;
-
-  gc_assert(is_generational(mrb));
+  gc_assert(mrb->live >= mrb->gc_live_after_mark);
+  mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
+  if (mrb->gc_threshold < GC_STEP_SIZE) {
+    mrb->gc_threshold = GC_STEP_SIZE;
+  }
+  mrb->malloc_increase = 0;
   if (is_major_gc(mrb)) {
-    advance_phase(mrb, GC_STATE_NONE);
+    mrb->majorgc_old_threshold = mrb->gc_live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
+    mrb->malloc_increase_old = 0;
+    mrb->gc_full = FALSE;
   }
-
-  mrb->is_generational_gc_mode = FALSE;
-  prepare_incremental_sweep(mrb);
-  advance_phase(mrb, GC_STATE_NONE);
-  mrb->variable_gray_list = mrb->gray_list = NULL;
-  mrb->is_generational_gc_mode = origin_mode;
+  else if (is_minor_gc(mrb)) {
+    if (mrb->live + malloc_slots(mrb, mrb->malloc_increase_old) > mrb->majorgc_old_threshold) {
+      clear_all_old(mrb);
+      mrb->gc_full = TRUE;
+    }
+  }
+  gc_trim_chunks(mrb);
 }
 
 void
 mrb_incremental_gc(mrb_state *mrb)
 {
+  uint64_t start;
+
   if (mrb->gc_disabled) return;
 
   GC_INVOKE_TIME_REPORT("mrb_incremental_gc()");
   GC_TIME_START;
+  start = gc_clock_ns();
 
-  if (is_minor_gc(mrb)) {
+  if (gc_sweeping_in_background(mrb)) {
+#ifdef MRB_GC_CONCURRENT_SWEEP
+    /* take back what the sweeper has finished, never wait for it */
+    concurrent_sweep_collect(mrb);
+#endif
+  }
+  else if (is_minor_gc(mrb)) {
     do {
       incremental_gc(mrb, ~0);
-    } while (mrb->gc_state != GC_STATE_NONE);
+    } while (mrb->gc_state != GC_STATE_NONE && !gc_sweeping_in_background(mrb));
+  }
+  else if (mrb->gc_step_budget_us > 0) {
+    incremental_gc_budget(mrb, (uint64_t)mrb->gc_step_budget_us);
   }
   else {
-    size_t limit = 0, result = 0;
+    size_t limit = 0, result = 0, debt;
     limit = (GC_STEP_SIZE/100) * mrb->gc_step_ratio;
+    /* work off allocation debt; up to twice the normal step */
+    debt = malloc_slots(mrb, mrb->malloc_increase);
+    limit += debt < limit ? debt : limit;
     while (result < limit) {
       result += incremental_gc(mrb, limit);
-      if (mrb->gc_state == GC_STATE_NONE)
+      if (mrb->gc_state == GC_STATE_NONE || gc_sweeping_in_background(mrb))
         break;
     }
   }
 
   if (mrb->gc_state == GC_STATE_NONE) {
-    gc_assert(mrb->live >= mrb->gc_live_after_mark);
-    mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
-    if (mrb->gc_threshold < GC_STEP_SIZE) {
-      mrb->gc_threshold = GC_STEP_SIZE;
-    }
-    if (is_major_gc(mrb)) {
-      mrb->majorgc_old_threshold = mrb->gc_live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
-      mrb->gc_full = FALSE;
-    }
-    else if (is_minor_gc(mrb)) {
-      if (mrb->live > mrb->majorgc_old_threshold) {
-        clear_all_old(mrb);
-        mrb->gc_full = TRUE;
-      }
-    }
+    incremental_gc_done(mrb);
   }
   else {
     mrb->gc_threshold = mrb->live + GC_STEP_SIZE;
   }
-
+  gc_pause_end(mrb, start);
 
   GC_TIME_STOP_AND_REPORT;
 }
@@ -877,10 +2063,12 @@ void
 mrb_garbage_collect(mrb_state *mrb)
 {
   size_t max_limit = ~0;
+  uint64_t start;
 
   if (mrb->gc_disabled) return;
   GC_INVOKE_TIME_REPORT("mrb_garbage_collect()");
   GC_TIME_START;
+  start = gc_clock_ns();
 
   if (mrb->gc_state == GC_STATE_SWEEP) {
     /* finish sweep phase */
@@ -895,16 +2083,29 @@ mrb_garbage_collect(mrb_state *mrb)
     mrb->gc_full = TRUE;
   }
 
-  do {
+  if (mrb->gc_state == GC_STATE_NONE) {
+    incremental_gc(mrb, max_limit);     /* root scan */
+    mrb->gc_stat.latest_full = TRUE;
+  }
+  while (mrb->gc_state != GC_STATE_NONE) {
+#ifdef MRB_GC_PARALLEL_MARK
+    if (mrb->gc_state == GC_STATE_MARK && mrb->gc_mark_workers > 1) {
+      gc_parallel_mark(mrb);
+    }
+#endif
     incremental_gc(mrb, max_limit);
-  } while (mrb->gc_state != GC_STATE_NONE);
+  }
 
   mrb->gc_threshold = (mrb->gc_live_after_mark/100) * mrb->gc_interval_ratio;
+  mrb->malloc_increase = 0;
+  mrb->malloc_increase_old = 0;
 
   if (is_generational(mrb)) {
     mrb->majorgc_old_threshold = mrb->gc_live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
     mrb->gc_full = FALSE;
   }
+  gc_trim_chunks(mrb);
+  gc_pause_end(mrb, start);
 
   GC_TIME_STOP_AND_REPORT;
 }
@@ -936,7 +2137,7 @@ mrb_field_write_barrier(mrb_state *mrb, struct RBasic *obj, struct RBasic *value
   gc_assert(is_generational(mrb) || mrb->gc_state != GC_STATE_NONE);
 
   if (is_generational(mrb) || mrb->gc_state == GC_STATE_MARK) {
-    add_gray_list(mrb, value);
+    add_gray(mrb, value);
   }
   else {
     gc_assert(mrb->gc_state == GC_STATE_SWEEP);
@@ -961,8 +2162,7 @@ mrb_write_barrier(mrb_state *mrb, struct RBasic *obj)
   gc_assert(!is_dead(mrb, obj));
   gc_assert(is_generational(mrb) || mrb->gc_state != GC_STATE_NONE);
   paint_gray(obj);
-  obj->gcnext = mrb->variable_gray_list;
-  mrb->variable_gray_list = obj;
+  gray_push(mrb, &mrb->variable_gray_stack, obj);
 }
 
 /*
@@ -1091,6 +2291,390 @@ gc_step_ratio_set(mrb_state *mrb, mrb_value obj)
   return mrb_nil_value();
 }
 
+/*
+ *  call-seq:
+ *     GC.malloc_ratio    -> fixnum
+ *
+ *  Returns the number of bytes allocated through mrb_malloc that are
+ *  counted as one heap slot when pacing GC. Default value is 256.
+ *
+ */
+
+static mrb_value
+gc_malloc_ratio_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_malloc_ratio);
+}
+
+/*
+ *  call-seq:
+ *     GC.malloc_ratio = fixnum   -> nil
+ *
+ *  Updates bytes per slot ratio of allocation pacing.
+ *  Allocated bytes do not start GC if you set 0.
+ *
+ */
+
+static mrb_value
+gc_malloc_ratio_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int ratio;
+
+  mrb_get_args(mrb, "i", &ratio);
+  if (ratio < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative malloc ratio");
+  }
+  mrb->gc_malloc_ratio = ratio;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.malloc_increase    -> fixnum
+ *
+ *  Returns bytes allocated through mrb_malloc since the last GC cycle.
+ *
+ */
+
+static mrb_value
+gc_malloc_increase(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value((mrb_int)mrb->malloc_increase);
+}
+
+/*
+ *  call-seq:
+ *     GC.step_budget_us    -> fixnum
+ *
+ *  Returns the time budget of an incremental GC step in microseconds.
+ *  0 (default) means steps are sized by step_ratio.
+ *
+ */
+
+static mrb_value
+gc_step_budget_us_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_step_budget_us);
+}
+
+/*
+ *  call-seq:
+ *     GC.step_budget_us = fixnum   -> nil
+ *
+ *  Updates the time budget of an incremental GC step. Minor GC in
+ *  generational mode, root scan and final marking are not split.
+ *
+ */
+
+static mrb_value
+gc_step_budget_us_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int budget;
+
+  mrb_get_args(mrb, "i", &budget);
+  if (budget < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative step budget");
+  }
+  mrb->gc_step_budget_us = budget;
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.mark_workers    -> fixnum
+ *
+ *  Returns the number of threads marking during a full GC.
+ *  Always 1 unless built with MRB_GC_PARALLEL_MARK.
+ *
+ */
+
+static mrb_value
+gc_mark_workers_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_mark_workers);
+}
+
+/*
+ *  call-seq:
+ *     GC.mark_workers = fixnum   -> nil
+ *
+ *  Updates the number of threads marking during a full GC
+ *  (GC.start).  Ignored without MRB_GC_PARALLEL_MARK.
+ *
+ */
+
+static mrb_value
+gc_mark_workers_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int n;
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 1) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "mark workers must be positive");
+  }
+#ifdef MRB_GC_PARALLEL_MARK
+  mrb->gc_mark_workers = n > GC_MARK_WORKERS_MAX ? GC_MARK_WORKERS_MAX : (int)n;
+#endif
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.concurrent_sweep    -> true or false
+ *
+ *  Returns whether pages are swept on a helper thread.  Off by
+ *  default; always false unless built with MRB_GC_CONCURRENT_SWEEP.
+ *
+ */
+
+static mrb_value
+gc_concurrent_sweep_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_bool_value(mrb->gc_concurrent_sweep);
+}
+
+/*
+ *  call-seq:
+ *     GC.concurrent_sweep = true or false   -> true or false
+ *
+ *  Turns sweeping on a helper thread on or off; a sweep in progress
+ *  is finished first.  Ignored without MRB_GC_CONCURRENT_SWEEP.
+ *
+ */
+
+static mrb_value
+gc_concurrent_sweep_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_bool enable;
+
+  mrb_get_args(mrb, "b", &enable);
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  if (mrb->sweep_job) {
+    while (mrb->sweep_job) {
+      concurrent_sweep_phase(mrb);
+    }
+    incremental_gc_done(mrb);
+  }
+  mrb->gc_concurrent_sweep = enable;
+#endif
+  return mrb_bool_value(enable);
+}
+
+/*
+ *  call-seq:
+ *     GC.huge_page_threshold    -> fixnum
+ *
+ *  Returns the number of heap pages in use from which new page chunks
+ *  are backed by transparent huge pages; 0 means never.
+ *  Always 0 unless built with MRB_GC_MMAP_PAGES.
+ *
+ */
+
+static mrb_value
+gc_huge_page_threshold_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_huge_page_threshold);
+}
+
+/*
+ *  call-seq:
+ *     GC.huge_page_threshold = fixnum   -> nil
+ *
+ *  Updates the heap size, in pages, from which new page chunks are
+ *  backed by transparent huge pages.  Ignored without MRB_GC_MMAP_PAGES.
+ *
+ */
+
+static mrb_value
+gc_huge_page_threshold_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int n;
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative threshold");
+  }
+#ifdef MRB_GC_MMAP_PAGES
+  mrb->gc_huge_page_threshold = (size_t)n;
+#endif
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.trim_threshold    -> fixnum
+ *
+ *  Returns the number of free heap pages kept resident; chunks without
+ *  any page in use beyond them are returned to the OS after each GC.
+ *  Always 0 unless built with MRB_GC_MMAP_PAGES.
+ *
+ */
+
+static mrb_value
+gc_trim_threshold_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value(mrb->gc_trim_threshold);
+}
+
+/*
+ *  call-seq:
+ *     GC.trim_threshold = fixnum   -> nil
+ *
+ *  Updates the number of free heap pages kept resident after a GC.
+ *  Ignored without MRB_GC_MMAP_PAGES.
+ *
+ */
+
+static mrb_value
+gc_trim_threshold_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int n;
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative threshold");
+  }
+#ifdef MRB_GC_MMAP_PAGES
+  mrb->gc_trim_threshold = (size_t)n;
+#endif
+  return mrb_nil_value();
+}
+
+#define gc_stat_set(mrb, h, name, v) \
+  mrb_hash_set((mrb), (h), mrb_symbol_value(mrb_intern_cstr((mrb), (name))), (v))
+#define gc_stat_int(n) mrb_fixnum_value((mrb_int)(n))
+
+/* [slot_size, live, free] of every heap page */
+static mrb_value
+gc_heap_pages_detail(mrb_state *mrb)
+{
+  struct heap_page *page;
+  size_t *counts, n = 0, i, j;
+  mrb_value ary;
+  int ai;
+
+#ifdef MRB_GC_CONCURRENT_SWEEP
+  /* the helper thread frees slots of the pages it sweeps */
+  while (mrb->sweep_job) {
+    concurrent_sweep_phase(mrb);
+  }
+#endif
+  /* count first: allocating objects may sweep and free pages */
+  for (page = mrb->heaps; page; page = page->next) n++;
+  counts = (size_t *)mrb_malloc(mrb, sizeof(size_t) * 3 * (n ? n : 1));
+  for (page = mrb->heaps, i = 0; page; page = page->next, i++) {
+    size_t live = 0;
+
+    for (j = 0; j < page->nslots; j++) {
+      if (page_slot(page, j)->tt != MRB_TT_FREE) live++;
+    }
+    counts[i * 3] = page->slot_size;
+    counts[i * 3 + 1] = live;
+    counts[i * 3 + 2] = page->nslots - live;
+  }
+  ary = mrb_ary_new_capa(mrb, (mrb_int)n);
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 0; i < n; i++) {
+    mrb_value e[3];
+
+    e[0] = gc_stat_int(counts[i * 3]);
+    e[1] = gc_stat_int(counts[i * 3 + 1]);
+    e[2] = gc_stat_int(counts[i * 3 + 2]);
+    mrb_ary_push(mrb, ary, mrb_ary_new_from_values(mrb, 3, e));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb_free(mrb, counts);
+  return ary;
+}
+
+/*
+ *  call-seq:
+ *     GC.stat        -> hash
+ *     GC.stat(key)   -> value
+ *
+ *  Returns collector statistics since the interpreter started: cycle
+ *  counts, heap slots, allocated and freed objects, bytes allocated
+ *  through mrb_malloc, the irep table slots in use and free for reuse,
+ *  and the time spent marking and sweeping and the longest pause, in
+ *  microseconds.
+ *
+ *  :heap_pages_detail lists [slot_size, live, free] for each heap page;
+ *  live counts every slot in use, including dead objects not yet
+ *  swept.  A sweep running on the helper thread is finished first.
+ *
+ *     GC.stat(:major_count)   #=> 3
+ *
+ */
+
+static mrb_value
+gc_stat(mrb_state *mrb, mrb_value obj)
+{
+  struct mrb_gc_stat *st = &mrb->gc_stat;
+  struct heap_page *page;
+  mrb_value key = mrb_nil_value();
+  mrb_value h;
+  size_t slots = 0, bytes = 0, live = mrb->live, pages = mrb->heap_pages;
+  int i;
+
+  for (page = mrb->heaps; page; page = page->next) {
+    slots += page->nslots;
+  }
+  mrb_get_args(mrb, "|o", &key);
+  for (i = 0; i < MRB_TT_MAXDEFINE; i++) {
+    bytes += mrb->malloc_bytes[i];
+  }
+  h = mrb_hash_new(mrb);
+  if (mrb_nil_p(key) || (mrb_symbol_p(key) && mrb_symbol(key) == mrb_intern_cstr(mrb, "heap_pages_detail"))) {
+    gc_stat_set(mrb, h, "heap_pages_detail", gc_heap_pages_detail(mrb));
+  }
+  gc_stat_set(mrb, h, "count", gc_stat_int(st->count));
+  gc_stat_set(mrb, h, "minor_count", gc_stat_int(st->minor_count));
+  gc_stat_set(mrb, h, "major_count", gc_stat_int(st->major_count));
+  gc_stat_set(mrb, h, "heap_pages", gc_stat_int(pages));
+  gc_stat_set(mrb, h, "heap_live_slots", gc_stat_int(live));
+  gc_stat_set(mrb, h, "heap_free_slots", gc_stat_int(slots - live));
+  gc_stat_set(mrb, h, "total_allocated_objects", gc_stat_int(st->total_allocated_objects));
+  gc_stat_set(mrb, h, "total_freed_objects", gc_stat_int(st->total_freed_objects));
+  gc_stat_set(mrb, h, "malloc_bytes", gc_stat_int(bytes));
+  gc_stat_set(mrb, h, "malloc_increase", gc_stat_int(mrb->malloc_increase));
+  gc_stat_set(mrb, h, "irep_slots", gc_stat_int(mrb->irep_len));
+  gc_stat_set(mrb, h, "irep_free_slots", gc_stat_int(mrb->irep_free));
+  gc_stat_set(mrb, h, "mark_time_us", gc_stat_int(st->mark_time_ns / 1000));
+  gc_stat_set(mrb, h, "sweep_time_us", gc_stat_int(st->sweep_time_ns / 1000));
+  gc_stat_set(mrb, h, "max_pause_us", gc_stat_int(st->max_pause_ns / 1000));
+  if (!mrb_nil_p(key)) {
+    return mrb_hash_get(mrb, h, key);
+  }
+  return h;
+}
+
+/*
+ *  call-seq:
+ *     GC.latest_info    -> hash
+ *
+ *  Describes the latest GC cycle, which may still be in progress
+ *  (:state is then :mark or :sweep).  Times are in microseconds.
+ *
+ */
+
+static mrb_value
+gc_latest_info(mrb_state *mrb, mrb_value obj)
+{
+  struct mrb_gc_stat *st = &mrb->gc_stat;
+  static const char *states[] = { "none", "mark", "sweep" };
+  mrb_value h = mrb_hash_new(mrb);
+
+  gc_stat_set(mrb, h, "major", mrb_bool_value(st->latest_major));
+  gc_stat_set(mrb, h, "full", mrb_bool_value(st->latest_full));
+  gc_stat_set(mrb, h, "state", mrb_symbol_value(mrb_intern_cstr(mrb, states[mrb->gc_state])));
+  gc_stat_set(mrb, h, "live_after_mark", gc_stat_int(st->latest_live_after_mark));
+  gc_stat_set(mrb, h, "freed", gc_stat_int(st->latest_freed));
+  gc_stat_set(mrb, h, "mark_time_us", gc_stat_int(st->latest_mark_time_ns / 1000));
+  gc_stat_set(mrb, h, "sweep_time_us", gc_stat_int(st->latest_sweep_time_ns / 1000));
+  gc_stat_set(mrb, h, "max_pause_us", gc_stat_int(st->latest_max_pause_ns / 1000));
+  return h;
+}
+
 static void
 change_gen_gc_mode(mrb_state *mrb, mrb_int enable)
 {
@@ -1141,6 +2725,43 @@ gc_generational_mode_set(mrb_state *mrb, mrb_value self)
   return mrb_bool_value(enable);
 }
 
+/*
+  Promotes every live object to the old generation: a full GC in
+  generational mode leaves survivors black, and full pages are
+  skipped by minor sweeps, so later minor GCs never write to them.
+  Call just before fork() to keep the heap shared copy-on-write.
+ */
+void
+mrb_gc_freeze_old(mrb_state *mrb)
+{
+  struct heap_page *page;
+
+  if (!is_generational(mrb)) {
+    change_gen_gc_mode(mrb, TRUE);
+  }
+  mrb_garbage_collect(mrb);
+  for (page = mrb->heaps; page; page = page->next) {
+    if (page->freelist == NULL)
+      page->old = TRUE;
+  }
+}
+
+/*
+ *  call-seq:
+ *     GC.freeze_old -> nil
+ *
+ *  Runs full GC and promotes all live objects to the old generation.
+ *  Switches to generational mode.
+ *
+ */
+
+static mrb_value
+gc_freeze_old(mrb_state *mrb, mrb_value self)
+{
+  mrb_gc_freeze_old(mrb);
+  return mrb_nil_value();
+}
+
 #ifdef GC_TEST
 #ifdef GC_DEBUG
 static mrb_value gc_test(mrb_state *, mrb_value);
@@ -1160,8 +2781,24 @@ mrb_init_gc(mrb_state *mrb)
   mrb_define_class_method(mrb, gc, "interval_ratio=", gc_interval_ratio_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "step_ratio", gc_step_ratio_get, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "step_ratio=", gc_step_ratio_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "malloc_ratio", gc_malloc_ratio_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "malloc_ratio=", gc_malloc_ratio_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "malloc_increase", gc_malloc_increase, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "step_budget_us", gc_step_budget_us_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "step_budget_us=", gc_step_budget_us_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "mark_workers", gc_mark_workers_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "mark_workers=", gc_mark_workers_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "concurrent_sweep", gc_concurrent_sweep_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "concurrent_sweep=", gc_concurrent_sweep_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "huge_page_threshold", gc_huge_page_threshold_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "huge_page_threshold=", gc_huge_page_threshold_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "trim_threshold", gc_trim_threshold_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "trim_threshold=", gc_trim_threshold_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "stat", gc_stat, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, gc, "latest_info", gc_latest_info, MRB_ARGS_NONE());
   mrb_define_class_method(mrb, gc, "generational_mode=", gc_generational_mode_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode", gc_generational_mode_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "freeze_old", gc_freeze_old, MRB_ARGS_NONE());
 #ifdef GC_TEST
 #ifdef GC_DEBUG
   mrb_define_class_method(mrb, gc, "test", gc_test, MRB_ARGS_NONE());
@@ -1197,8 +2834,8 @@ test_mrb_field_write_barrier(void)
   mrb->gc_state = GC_STATE_SWEEP;
   mrb_field_write_barrier(mrb, obj, value);
 
-  gc_assert(obj->color & mrb->current_white_part);
-  gc_assert(value->color & mrb->current_white_part);
+  gc_assert(gc_color(obj) & mrb->current_white_part);
+  gc_assert(gc_color(value) & mrb->current_white_part);
 
 
   puts("  fail with black");
@@ -1207,7 +2844,7 @@ test_mrb_field_write_barrier(void)
   paint_partial_white(mrb,value);
   mrb_field_write_barrier(mrb, obj, value);
 
-  gc_assert(obj->color & mrb->current_white_part);
+  gc_assert(gc_color(obj) & mrb->current_white_part);
 
 
   puts("  fail with gray");
@@ -1250,7 +2887,7 @@ test_mrb_write_barrier(void)
   mrb_write_barrier(mrb, obj);
 
   gc_assert(is_gray(obj));
-  gc_assert(mrb->variable_gray_list == obj);
+  gc_assert(mrb->variable_gray_stack.objs[mrb->variable_gray_stack.len-1] == obj);
 
 
   puts("  fail with gray");
@@ -1263,23 +2900,23 @@ test_mrb_write_barrier(void)
 }
 
 void
-test_add_gray_list(void)
+test_add_gray(void)
 {
   mrb_state *mrb = mrb_open();
   struct RBasic *obj1, *obj2;
 
-  puts("test_add_gray_list");
+  puts("test_add_gray");
   change_gen_gc_mode(mrb, FALSE);
-  gc_assert(mrb->gray_list == NULL);
+  gc_assert(mrb->gray_stack.len == 0);
   obj1 = mrb_basic_ptr(mrb_str_new_cstr(mrb, "test"));
-  add_gray_list(mrb, obj1);
-  gc_assert(mrb->gray_list == obj1);
+  add_gray(mrb, obj1);
+  gc_assert(mrb->gray_stack.objs[0] == obj1);
   gc_assert(is_gray(obj1));
 
   obj2 = mrb_basic_ptr(mrb_str_new_cstr(mrb, "test"));
-  add_gray_list(mrb, obj2);
-  gc_assert(mrb->gray_list == obj2);
-  gc_assert(mrb->gray_list->gcnext == obj1);
+  add_gray(mrb, obj2);
+  gc_assert(mrb->gray_stack.len == 2);
+  gc_assert(mrb->gray_stack.objs[1] == obj2);
   gc_assert(is_gray(obj2));
 
   mrb_close(mrb);
@@ -1321,11 +2958,13 @@ test_incremental_gc(void)
 {
   mrb_state *mrb = mrb_open();
   size_t max = ~0, live = 0, total = 0, freed = 0;
-  RVALUE *free;
+  struct free_obj *free;
   struct heap_page *page;
+  size_t i;
 
   puts("test_incremental_gc");
   change_gen_gc_mode(mrb, FALSE);
+  mrb->gc_concurrent_sweep = FALSE;
 
   puts("  in mrb_garbage_collect");
   mrb_garbage_collect(mrb);
@@ -1341,22 +2980,21 @@ test_incremental_gc(void)
   puts("  in GC_STATE_SWEEP");
   page = mrb->heaps;
   while (page) {
-    RVALUE *p = page->objects;
-    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
-    while (p<e) {
-      if (is_black(&p->as.basic)) {
+    for (i = 0; i < page->nslots; i++) {
+      struct RBasic *obj = page_slot(page, i);
+
+      if (is_black(obj)) {
         live++;
       }
-      if (is_gray(&p->as.basic) && !is_dead(mrb, &p->as.basic)) {
-        printf("%p\n", &p->as.basic);
+      if (is_gray(obj) && !is_dead(mrb, obj)) {
+        printf("%p\n", obj);
       }
-      p++;
     }
+    total += page->nslots;
     page = page->next;
-    total += MRB_HEAP_PAGE_SIZE;
   }
 
-  gc_assert(mrb->gray_list == NULL);
+  gc_assert(mrb->gray_stack.len == 0);
 
   incremental_gc(mrb, max);
   gc_assert(mrb->gc_state == GC_STATE_SWEEP);
@@ -1364,10 +3002,10 @@ test_incremental_gc(void)
   incremental_gc(mrb, max);
   gc_assert(mrb->gc_state == GC_STATE_NONE);
 
-  free = (RVALUE*)mrb->heaps->freelist;
+  free = (struct free_obj*)mrb->heaps->freelist;
   while (free) {
    freed++;
-   free = (RVALUE*)free->as.free.next;
+   free = (struct free_obj*)free->next;
   }
 
   gc_assert(mrb->live == live);
@@ -1405,15 +3043,15 @@ test_incremental_sweep_phase(void)
 
   puts("test_incremental_sweep_phase");
 
-  add_heap(mrb);
+  add_heap(mrb, GC_SLOT_LARGE);
   mrb->sweeps = mrb->heaps;
 
   gc_assert(mrb->heaps->next->next == NULL);
-  gc_assert(mrb->free_heaps->next->next == NULL);
+  gc_assert(mrb->free_heaps[GC_SLOT_LARGE]->next->next == NULL);
   incremental_sweep_phase(mrb, MRB_HEAP_PAGE_SIZE*3);
 
   gc_assert(mrb->heaps->next == NULL);
-  gc_assert(mrb->heaps == mrb->free_heaps);
+  gc_assert(mrb->heaps == mrb->free_heaps[GC_SLOT_LARGE]);
 
   mrb_close(mrb);
 }
@@ -1423,7 +3061,7 @@ gc_test(mrb_state *mrb, mrb_value self)
 {
   test_mrb_field_write_barrier();
   test_mrb_write_barrier();
-  test_add_gray_list();
+  test_add_gray();
   test_gc_gray_mark();
   test_incremental_gc();
   test_incremental_sweep_phase();
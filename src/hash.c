@@ -30,7 +30,7 @@ mrb_hash_ht_hash_equal(mrb_state *mrb, mrb_value a, mrb_value b)
 }
 
 KHASH_DECLARE(ht, mrb_value, mrb_value, 1)
-KHASH_DEFINE (ht, mrb_value, mrb_value, 1, mrb_hash_ht_hash_func, mrb_hash_ht_hash_equal)
+KHASH_DEFINE_TT(ht, mrb_value, mrb_value, 1, mrb_hash_ht_hash_func, mrb_hash_ht_hash_equal, MRB_TT_HASH)
 
 static void mrb_hash_modify(mrb_state *mrb, mrb_value hash);
 
@@ -315,15 +315,14 @@ to_hash(mrb_state *mrb, mrb_value hash)
  *     h["c"]   #=> nil
  *
  */
-mrb_value
-mrb_hash_aget(mrb_state *mrb, mrb_value self)
+static mrb_value
+mrb_hash_aget(mrb_state *mrb, mrb_value self, mrb_arg *argv, int argc)
 {
-  mrb_value key;
-
-  mrb_get_args(mrb, "o", &key);
-  return mrb_hash_get(mrb, self, key);
+  return mrb_hash_get(mrb, self, argv[0].v);
 }
 
+static const mrb_argspec hash_aget_spec = MRB_ARGSPEC(mrb_hash_aget, 1, 0, 0, 0, NULL);
+
 /*
  *  call-seq:
  *     hsh.fetch(key [, default] )       -> obj
@@ -679,16 +678,15 @@ mrb_hash_clear(mrb_state *mrb, mrb_value hash)
  *     h   #=> {"a"=>9, "b"=>200, "c"=>4}
  *
  */
-mrb_value
-mrb_hash_aset(mrb_state *mrb, mrb_value self)
+static mrb_value
+mrb_hash_aset(mrb_state *mrb, mrb_value self, mrb_arg *argv, int argc)
 {
-  mrb_value key, val;
-
-  mrb_get_args(mrb, "oo", &key, &val);
-  mrb_hash_set(mrb, self, key, val);
-  return val;
+  mrb_hash_set(mrb, self, argv[0].v, argv[1].v);
+  return argv[1].v;
 }
 
+static const mrb_argspec hash_aset_spec = MRB_ARGSPEC(mrb_hash_aset, 2, 0, 0, 0, NULL, NULL);
+
 /* 15.2.13.4.17 */
 /* 15.2.13.4.23 */
 /*
@@ -1237,15 +1235,15 @@ mrb_init_hash(mrb_state *mrb)
 
   mrb_include_module(mrb, h, mrb_class_get(mrb, "Enumerable"));
   mrb_define_method(mrb, h, "==",              mrb_hash_equal,       MRB_ARGS_REQ(1)); /* 15.2.13.4.1  */
-  mrb_define_method(mrb, h, "[]",              mrb_hash_aget,        MRB_ARGS_REQ(1)); /* 15.2.13.4.2  */
-  mrb_define_method(mrb, h, "[]=",             mrb_hash_aset,        MRB_ARGS_REQ(2)); /* 15.2.13.4.3  */
+  mrb_define_method_spec(mrb, h, "[]",         &hash_aget_spec);                   /* 15.2.13.4.2  */
+  mrb_define_method_spec(mrb, h, "[]=",        &hash_aset_spec);                   /* 15.2.13.4.3  */
   mrb_define_method(mrb, h, "clear",           mrb_hash_clear,       MRB_ARGS_NONE()); /* 15.2.13.4.4  */
   mrb_define_method(mrb, h, "default",         mrb_hash_default,     MRB_ARGS_ANY());  /* 15.2.13.4.5  */
   mrb_define_method(mrb, h, "default=",        mrb_hash_set_default, MRB_ARGS_REQ(1)); /* 15.2.13.4.6  */
   mrb_define_method(mrb, h, "default_proc",    mrb_hash_default_proc,MRB_ARGS_NONE()); /* 15.2.13.4.7  */
   mrb_define_method(mrb, h, "default_proc=",   mrb_hash_set_default_proc,MRB_ARGS_REQ(1)); /* 15.2.13.4.7  */
   mrb_define_method(mrb, h, "__delete",        mrb_hash_delete,      MRB_ARGS_REQ(1)); /* core of 15.2.13.4.8  */
-  mrb_define_method(mrb, h, "empty?",          mrb_hash_empty_p,     MRB_ARGS_NONE()); /* 15.2.13.4.12 */
+  mrb_define_leaf_method(mrb, h, "empty?",          mrb_hash_empty_p);                 /* 15.2.13.4.12 */
   mrb_define_method(mrb, h, "has_key?",        mrb_hash_has_key,     MRB_ARGS_REQ(1)); /* 15.2.13.4.13 */
   mrb_define_method(mrb, h, "has_value?",      mrb_hash_has_value,   MRB_ARGS_REQ(1)); /* 15.2.13.4.14 */
   mrb_define_method(mrb, h, "include?",        mrb_hash_has_key,     MRB_ARGS_REQ(1)); /* 15.2.13.4.15 */
@@ -1253,12 +1251,12 @@ mrb_init_hash(mrb_state *mrb)
   mrb_define_method(mrb, h, "initialize_copy", mrb_hash_replace,     MRB_ARGS_REQ(1)); /* 15.2.13.4.17 */
   mrb_define_method(mrb, h, "key?",            mrb_hash_has_key,     MRB_ARGS_REQ(1)); /* 15.2.13.4.18 */
   mrb_define_method(mrb, h, "keys",            mrb_hash_keys,        MRB_ARGS_NONE()); /* 15.2.13.4.19 */
-  mrb_define_method(mrb, h, "length",          mrb_hash_size_m,      MRB_ARGS_NONE()); /* 15.2.13.4.20 */
+  mrb_define_leaf_method(mrb, h, "length",          mrb_hash_size_m);                  /* 15.2.13.4.20 */
   mrb_define_method(mrb, h, "member?",         mrb_hash_has_key,     MRB_ARGS_REQ(1)); /* 15.2.13.4.21 */
   mrb_define_method(mrb, h, "replace",         mrb_hash_replace,     MRB_ARGS_REQ(1)); /* 15.2.13.4.23 */
   mrb_define_method(mrb, h, "shift",           mrb_hash_shift,       MRB_ARGS_NONE()); /* 15.2.13.4.24 */
-  mrb_define_method(mrb, h, "size",            mrb_hash_size_m,      MRB_ARGS_NONE()); /* 15.2.13.4.25 */
-  mrb_define_method(mrb, h, "store",           mrb_hash_aset,        MRB_ARGS_REQ(2)); /* 15.2.13.4.26 */
+  mrb_define_leaf_method(mrb, h, "size",            mrb_hash_size_m);                  /* 15.2.13.4.25 */
+  mrb_define_method_spec(mrb, h, "store",      &hash_aset_spec);                   /* 15.2.13.4.26 */
   mrb_define_method(mrb, h, "value?",          mrb_hash_has_value,   MRB_ARGS_REQ(1)); /* 15.2.13.4.27 */
   mrb_define_method(mrb, h, "values",          mrb_hash_values,      MRB_ARGS_NONE()); /* 15.2.13.4.28 */
 
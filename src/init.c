@@ -48,6 +48,8 @@ mrb_init_core(mrb_state *mrb)
   mrb_init_range(mrb); DONE;
   mrb_init_gc(mrb); DONE;
   mrb_init_mrblib(mrb); DONE;
+  /* core operator definitions above do not count as redefinitions */
+  mrb->bop_redefined = 0;
 #ifndef DISABLE_GEMS
   mrb_init_mrbgems(mrb); DONE;
 #endif
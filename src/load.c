@@ -29,29 +29,38 @@
 # error This code assumes CHAR_BIT == 8
 #endif
 
+/* layout of the image being read */
+#define FLAG_ISEQ_PADDED       1  /* iseq is preceded by alignment padding */
+#define FLAG_BYTEORDER_LIL     2  /* iseq is little-endian */
+#define FLAG_BYTEORDER_NATIVE  4  /* iseq is in host byte order */
+#define FLAG_SRC_STATIC        8  /* image outlives the mrb_state */
+#define FLAG_POOL_BINARY      16  /* numeric pool entries are binary */
+#define FLAG_SYMS_SHARED      32  /* ireps index into the SYMS section */
+#define FLAG_LAZY             64  /* decode irep bodies on first call */
+#define FLAG_LINES_PACKED    128  /* LINE records hold packed line tables */
+
+/* state shared by the sections of one image; lazily loaded images keep
+   it in mrb->irep_images until mrb_close() */
+struct rite_load_ctx {
+  uint8_t flags;
+  mrb_sym *syms;        /* SYMS section, interned */
+  uint32_t nsyms;
+  struct rite_load_ctx *next;
+};
+
+/* drops the ireps of a failed load, which are not sealed into a unit */
 static void
 irep_free(size_t sirep, mrb_state *mrb)
 {
   size_t i;
-  void *p;
 
   for (i = sirep; i < mrb->irep_len; i++) {
     if (mrb->irep[i]) {
-      p = mrb->irep[i]->iseq;
-      if (p)
-        mrb_free(mrb, p);
-
-      p = mrb->irep[i]->pool;
-      if (p)
-        mrb_free(mrb, p);
-
-      p = mrb->irep[i]->syms;
-      if (p)
-        mrb_free(mrb, p);
-
-      mrb_free(mrb, mrb->irep[i]);
+      mrb_irep_free(mrb, mrb->irep[i]);
+      mrb->irep[i] = NULL;
     }
   }
+  mrb->irep_len = sirep;
 }
 
 static size_t
@@ -61,45 +70,56 @@ offset_crc_body(void)
   return ((uint8_t *)header.binary_crc - (uint8_t *)&header) + sizeof(header.binary_crc);
 }
 
+/* decodes iseq, pool and syms; *srcp is advanced past them */
 static int
-read_rite_irep_record(mrb_state *mrb, const uint8_t *bin, uint32_t *len)
+read_rite_irep_body(mrb_state *mrb, mrb_irep *irep, const uint8_t **srcp, struct rite_load_ctx *ctx)
 {
   int ret;
+  uint8_t flags = ctx->flags;
   size_t i;
-  const uint8_t *src = bin;
+  const uint8_t *src = *srcp;
   uint16_t tt, pool_data_len, snl;
   size_t plen;
   int ai = mrb_gc_arena_save(mrb);
-  mrb_irep *irep = mrb_add_irep(mrb);
-
-  // skip record size
-  src += sizeof(uint32_t);
-
-  // number of local variable
-  irep->nlocals = bin_to_uint16(src);
-  src += sizeof(uint16_t);
-
-  // number of register variable
-  irep->nregs = bin_to_uint16(src);
-  src += sizeof(uint16_t);
 
   // Binary Data Section
   // ISEQ BLOCK
   irep->ilen = bin_to_uint32(src);
   src += sizeof(uint32_t);
+  if (flags & FLAG_ISEQ_PADDED) {
+    src += sizeof(uint8_t) + bin_to_uint8(src);
+  }
   if (irep->ilen > 0) {
     if (SIZE_ERROR_MUL(sizeof(mrb_code), irep->ilen)) {
       ret = MRB_DUMP_GENERAL_FAILURE;
       goto error_exit;
     }
-    irep->iseq = (mrb_code *)mrb_malloc(mrb, sizeof(mrb_code) * irep->ilen);
-    if (irep->iseq == NULL) {
-      ret = MRB_DUMP_GENERAL_FAILURE;
-      goto error_exit;
+    if ((flags & FLAG_SRC_STATIC) && (flags & FLAG_BYTEORDER_NATIVE) &&
+        ((uintptr_t)src & (MRB_DUMP_ALIGNMENT - 1)) == 0) {
+      /* execute in place; the image is never written to */
+      irep->iseq = (mrb_code *)src;
+      irep->flags |= MRB_ISEQ_NO_FREE;
+      src += sizeof(mrb_code) * irep->ilen;
     }
-    for (i = 0; i < irep->ilen; i++) {
-      irep->iseq[i] = bin_to_uint32(src);     //iseq
-      src += sizeof(uint32_t);
+    else {
+      irep->iseq = (mrb_code *)mrb_malloc(mrb, sizeof(mrb_code) * irep->ilen);
+      if (irep->iseq == NULL) {
+        ret = MRB_DUMP_GENERAL_FAILURE;
+        goto error_exit;
+      }
+      if (flags & FLAG_BYTEORDER_NATIVE) {
+        memcpy(irep->iseq, src, sizeof(mrb_code) * irep->ilen);
+        src += sizeof(mrb_code) * irep->ilen;
+      }
+      else {
+        for (i = 0; i < irep->ilen; i++) {
+          if (flags & FLAG_BYTEORDER_LIL)
+            irep->iseq[i] = bin_to_uint32_lil(src);
+          else
+            irep->iseq[i] = bin_to_uint32(src);     //iseq
+          src += sizeof(uint32_t);
+        }
+      }
     }
   }
 
@@ -120,28 +140,77 @@ read_rite_irep_record(mrb_state *mrb, const uint8_t *bin, uint32_t *len)
     for (i = 0; i < plen; i++) {
       mrb_value s;
       tt = *src++; //pool TT
-      pool_data_len = bin_to_uint16(src); //pool data length
-      src += sizeof(uint16_t);
-      s = mrb_str_new(mrb, (char *)src, pool_data_len);
-      src += pool_data_len;
-      switch (tt) { //pool data
-      case MRB_TT_FIXNUM:
-        irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
-        break;
-
-      case MRB_TT_FLOAT:
-        irep->pool[i] = mrb_float_value(mrb_str_to_dbl(mrb, s, FALSE));
-        break;
-
-      case MRB_TT_STRING:
-        irep->pool[i] = s;
-        break;
-
-      default:
-        irep->pool[i] = mrb_nil_value();
-        break;
+      if (flags & FLAG_POOL_BINARY) {
+        switch (tt) { //pool data
+        case IREP_TT_INT32:
+        case IREP_TT_INT64:
+          {
+            int64_t v;
+
+            if (tt == IREP_TT_INT32) {
+              v = (int32_t)bin_to_uint32(src);
+              src += sizeof(uint32_t);
+            }
+            else {
+              v = (int64_t)bin_to_uint64(src);
+              src += sizeof(uint64_t);
+            }
+            /* literals wider than this build's mrb_int become floats */
+            if (v < MRB_INT_MIN || v > MRB_INT_MAX)
+              irep->pool[i] = mrb_float_value((mrb_float)v);
+            else
+              irep->pool[i] = mrb_fixnum_value((mrb_int)v);
+          }
+          break;
+
+        case IREP_TT_FLOAT:
+          {
+            uint64_t u = bin_to_uint64(src);
+            double f;
+
+            memcpy(&f, &u, sizeof(double));
+            irep->pool[i] = mrb_float_value((mrb_float)f);
+            src += sizeof(uint64_t);
+          }
+          break;
+
+        case IREP_TT_STRING:
+          pool_data_len = bin_to_uint16(src); //pool data length
+          src += sizeof(uint16_t);
+          irep->pool[i] = mrb_str_new(mrb, (char *)src, pool_data_len);
+          src += pool_data_len;
+          break;
+
+        default:
+          ret = MRB_DUMP_INVALID_IREP;
+          goto error_exit;
+        }
+      }
+      else {
+        pool_data_len = bin_to_uint16(src); //pool data length
+        src += sizeof(uint16_t);
+        s = mrb_str_new(mrb, (char *)src, pool_data_len);
+        src += pool_data_len;
+        switch (tt) { //pool data
+        case MRB_TT_FIXNUM:
+          irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
+          break;
+
+        case MRB_TT_FLOAT:
+          irep->pool[i] = mrb_float_value(mrb_str_to_dbl(mrb, s, FALSE));
+          break;
+
+        case MRB_TT_STRING:
+          irep->pool[i] = s;
+          break;
+
+        default:
+          irep->pool[i] = mrb_nil_value();
+          break;
+        }
       }
       irep->plen++;
+      mrb_irep_pool_barrier(mrb, irep);
       mrb_gc_arena_restore(mrb, ai);
     }
   }
@@ -161,6 +230,23 @@ read_rite_irep_record(mrb_state *mrb, const uint8_t *bin, uint32_t *len)
     }
 
     for (i = 0; i < irep->slen; i++) {
+      if (flags & FLAG_SYMS_SHARED) {
+        uint32_t idx = bin_to_uint32(src);    //index into SYMS
+        src += sizeof(uint32_t);
+
+        if (idx == MRB_DUMP_NULL_SYM_INDEX) {
+          irep->syms[i] = 0;
+        }
+        else if (idx < ctx->nsyms) {
+          irep->syms[i] = ctx->syms[idx];
+        }
+        else {
+          ret = MRB_DUMP_INVALID_IREP;
+          goto error_exit;
+        }
+        continue;
+      }
+
       snl = bin_to_uint16(src);               //symbol name length
       src += sizeof(uint16_t);
 
@@ -175,7 +261,7 @@ read_rite_irep_record(mrb_state *mrb, const uint8_t *bin, uint32_t *len)
       mrb_gc_arena_restore(mrb, ai);
     }
   }
-  *len = src - bin;
+  *srcp = src;
 
   ret = MRB_DUMP_OK;
 error_exit:
@@ -183,7 +269,84 @@ error_exit:
 }
 
 static int
-read_rite_section_irep(mrb_state *mrb, const uint8_t *bin)
+read_rite_irep_record(mrb_state *mrb, const uint8_t *bin, uint32_t *len, struct rite_load_ctx *ctx)
+{
+  int ret;
+  const uint8_t *src = bin;
+  mrb_irep *irep = mrb_add_irep(mrb);
+
+  // skip record size
+  src += sizeof(uint32_t);
+
+  // number of local variable
+  irep->nlocals = bin_to_uint16(src);
+  src += sizeof(uint16_t);
+
+  // number of register variable
+  irep->nregs = bin_to_uint16(src);
+  src += sizeof(uint16_t);
+
+  if (ctx->flags & FLAG_LAZY) {
+    irep->flags |= MRB_IREP_LAZY;
+    irep->lazy_body = src;
+    irep->lazy_ctx = ctx;
+    *len = bin_to_uint32(bin);
+    return MRB_DUMP_OK;
+  }
+
+  ret = read_rite_irep_body(mrb, irep, &src, ctx);
+  *len = src - bin;
+  return ret;
+}
+
+static int
+irep_decode(mrb_state *mrb, mrb_irep *irep)
+{
+  const uint8_t *src = irep->lazy_body;
+
+  if (!(irep->flags & MRB_IREP_LAZY)) return MRB_DUMP_OK;
+  irep->flags &= ~MRB_IREP_LAZY;
+  if (read_rite_irep_body(mrb, irep, &src, irep->lazy_ctx) != MRB_DUMP_OK) {
+    /* leave it undecoded so that every later call fails the same way */
+    if (!(irep->flags & MRB_ISEQ_NO_FREE)) mrb_free(mrb, irep->iseq);
+    mrb_free(mrb, irep->pool);
+    mrb_free(mrb, irep->syms);
+    irep->iseq = NULL;
+    irep->pool = NULL;
+    irep->syms = NULL;
+    irep->ilen = irep->plen = irep->slen = 0;
+    irep->flags |= MRB_IREP_LAZY;
+    return MRB_DUMP_INVALID_IREP;
+  }
+  irep->lazy_body = NULL;
+  irep->lazy_ctx = NULL;
+  return MRB_DUMP_OK;
+}
+
+void
+mrb_irep_decode(mrb_state *mrb, mrb_irep *irep)
+{
+  if (irep_decode(mrb, irep) != MRB_DUMP_OK) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "irep load error");
+  }
+}
+
+void
+mrb_free_irep_images(mrb_state *mrb)
+{
+  struct rite_load_ctx *ctx = mrb->irep_images, *next;
+
+  while (ctx) {
+    next = ctx->next;
+    mrb_free(mrb, ctx->syms);
+    mrb_free(mrb, ctx);
+    ctx = next;
+  }
+  mrb->irep_images = NULL;
+}
+
+static int
+read_rite_section_irep(mrb_state *mrb, const uint8_t *bin, struct rite_load_ctx *ctx)
 {
   int result;
   size_t sirep;
@@ -201,81 +364,161 @@ read_rite_section_irep(mrb_state *mrb, const uint8_t *bin)
 
   //Read Binary Data Section
   for (n = 0, i = sirep; n < nirep; n++, i++) {
-    result = read_rite_irep_record(mrb, bin, &len);
+    result = read_rite_irep_record(mrb, bin, &len, ctx);
     if (result != MRB_DUMP_OK)
-      goto error_exit;
+      return result;
     bin += len;
   }
 
-  result = sirep + bin_to_uint16(header->sirep);
-error_exit:
-  if (result < MRB_DUMP_OK) {
-    irep_free(sirep, mrb);
+  return sirep + bin_to_uint16(header->sirep);
+}
+
+/* interns every distinct name of the image once */
+static int
+read_rite_section_syms(mrb_state *mrb, const uint8_t *bin, struct rite_load_ctx *ctx)
+{
+  const struct rite_section_syms_header *header;
+  uint32_t nsyms, i;
+  uint16_t snl;
+
+  header = (const struct rite_section_syms_header*)bin;
+  bin += sizeof(struct rite_section_syms_header);
+
+  nsyms = bin_to_uint32(header->nsyms);
+  if (nsyms == 0 || ctx->syms) {
+    return MRB_DUMP_OK;
   }
-  return result;
+  if (SIZE_ERROR_MUL(sizeof(mrb_sym), nsyms)) {
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+  ctx->syms = (mrb_sym *)mrb_malloc(mrb, sizeof(mrb_sym) * nsyms);
+  if (ctx->syms == NULL) {
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
+  for (i = 0; i < nsyms; i++) {
+    snl = bin_to_uint16(bin);                 //symbol name length
+    bin += sizeof(uint16_t);
+    ctx->syms[i] = mrb_intern2(mrb, (char *)bin, snl);
+    bin += snl + 1;
+  }
+  ctx->nsyms = nsyms;
+
+  return MRB_DUMP_OK;
 }
 
+/* reads one LEB128 field of at most 5 bytes without passing end */
+static const uint8_t*
+leb128_skip(const uint8_t *p, const uint8_t *end, uint32_t *v)
+{
+  int shift = 0;
+
+  *v = 0;
+  while (p < end && shift < 35) {
+    *v |= (uint32_t)(*p & 0x7f) << shift;
+    shift += 7;
+    if (!(*p++ & 0x80)) return p;
+  }
+  return NULL;
+}
+
+/* checks that the runs of a packed table cover exactly niseq instructions */
 static int
-read_rite_lineno_record(mrb_state *mrb, const uint8_t *bin, size_t irepno, uint32_t *len)
+line_table_valid_p(const uint8_t *table, size_t table_size, size_t niseq)
 {
-  int ret;
-  size_t i, fname_len, niseq;
-  char *fname;
+  const uint8_t *p = table, *end = table + table_size;
+  size_t pc = 0;
+  uint32_t run, delta;
+
+  while (p && p < end) {
+    p = leb128_skip(p, end, &run);
+    if (p == NULL || run == 0 || niseq - pc < run) return FALSE;
+    pc += run;
+    p = leb128_skip(p, end, &delta);
+  }
+  return p != NULL && pc == niseq;
+}
+
+/* the iseq length of irep, read from its record while it is lazy */
+static uint32_t
+irep_ilen(mrb_irep *irep)
+{
+  if (irep->flags & MRB_IREP_LAZY) {
+    return bin_to_uint32(irep->lazy_body);
+  }
+  return irep->ilen;
+}
+
+static int
+read_rite_lineno_record(mrb_state *mrb, const uint8_t *bin, size_t irepno, uint32_t *len, uint8_t flags, const char **fname)
+{
+  mrb_irep *irep = mrb->irep[irepno];
+  size_t i, fname_len, niseq, table_size;
+  const uint8_t *src = bin;
   uint16_t *lines;
 
-  ret = MRB_DUMP_OK;
-  *len = 0;
-  bin += sizeof(uint32_t); // record size
-  *len += sizeof(uint32_t);
-  fname_len = bin_to_uint16(bin);
-  bin += sizeof(uint16_t);
-  *len += sizeof(uint16_t);
-  if (SIZE_ERROR(fname_len + 1)) {
-    ret = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
-  }
-  fname = (char *)mrb_malloc(mrb, fname_len + 1);
-  if (fname == NULL) {
-    ret = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
-  }
-  memcpy(fname, bin, fname_len);
-  fname[fname_len] = '\0';
-  bin += fname_len;
-  *len += fname_len;
-
-  niseq = bin_to_uint32(bin);
-  bin += sizeof(uint32_t); // niseq
-  *len += sizeof(uint32_t);
-
-  if (SIZE_ERROR_MUL(niseq, sizeof(uint16_t))) {
-    ret = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
-  }
-  lines = (uint16_t *)mrb_malloc(mrb, niseq * sizeof(uint16_t));
-  if (lines == NULL) {
-    ret = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
-  }
-  for (i = 0; i < niseq; i++) {
-    lines[i] = bin_to_uint16(bin);
-    bin += sizeof(uint16_t); // niseq
-    *len += sizeof(uint16_t);
- }
-
-  mrb->irep[irepno]->filename = fname;
-  mrb->irep[irepno]->lines = lines;
+  src += sizeof(uint32_t); // record size
+  fname_len = bin_to_uint16(src);
+  src += sizeof(uint16_t);
+  /* every irep of a file carries the same name; intern it once so that
+     it lives as long as the symbol table */
+  if (*fname == NULL || strlen(*fname) != fname_len || memcmp(*fname, src, fname_len) != 0) {
+    *fname = mrb_sym2name_len(mrb, mrb_intern2(mrb, (const char *)src, fname_len), &i);
+  }
+  src += fname_len;
 
-error_exit:
-  if (fname) {
-    mrb_free(mrb, fname);
+  niseq = bin_to_uint32(src);
+  src += sizeof(uint32_t); // niseq
+  /* a table of any other length would be read past the iseq */
+  if (niseq > 0 && niseq != irep_ilen(irep)) {
+    return MRB_DUMP_GENERAL_FAILURE;
   }
 
-  return ret;
+  if (flags & FLAG_LINES_PACKED) {
+    if (niseq > 0) {
+      table_size = bin_to_uint32(src);
+      src += sizeof(uint32_t);
+      if (!line_table_valid_p(src, table_size, niseq)) {
+        return MRB_DUMP_GENERAL_FAILURE;
+      }
+      if (flags & FLAG_SRC_STATIC) {
+        irep->line_table = src;
+        irep->flags |= MRB_LINES_NO_FREE;
+      }
+      else {
+        uint8_t *table = (uint8_t *)mrb_malloc(mrb, table_size);
+
+        if (table == NULL) {
+          return MRB_DUMP_GENERAL_FAILURE;
+        }
+        memcpy(table, src, table_size);
+        irep->line_table = table;
+      }
+      src += table_size;
+    }
+  }
+  else if (niseq > 0) {
+    if (SIZE_ERROR_MUL(niseq, sizeof(uint16_t))) {
+      return MRB_DUMP_GENERAL_FAILURE;
+    }
+    lines = (uint16_t *)mrb_malloc(mrb, niseq * sizeof(uint16_t));
+    if (lines == NULL) {
+      return MRB_DUMP_GENERAL_FAILURE;
+    }
+    for (i = 0; i < niseq; i++) {
+      lines[i] = bin_to_uint16(src);
+      src += sizeof(uint16_t);
+    }
+    irep->line_table = mrb_irep_line_table(mrb, lines, niseq);
+    mrb_free(mrb, lines);
+  }
+
+  irep->filename = *fname;
+  *len = src - bin;
+  return MRB_DUMP_OK;
 }
 
 static int
-read_rite_section_lineno(mrb_state *mrb, const uint8_t *bin, size_t sirep)
+read_rite_section_lineno(mrb_state *mrb, const uint8_t *bin, size_t sirep, uint8_t flags)
 {
   int result;
   size_t i;
@@ -283,16 +526,20 @@ read_rite_section_lineno(mrb_state *mrb, const uint8_t *bin, size_t sirep)
   uint16_t nirep;
   uint16_t n;
   const struct rite_section_lineno_header *header;
+  const char *fname = NULL;
 
   len = 0;
   header = (const struct rite_section_lineno_header*)bin;
   bin += sizeof(struct rite_section_lineno_header);
 
   nirep = bin_to_uint16(header->nirep);
+  if (sirep + nirep > mrb->irep_len) {
+    return MRB_DUMP_GENERAL_FAILURE;
+  }
 
   //Read Binary Data Section
   for (n = 0, i = sirep; n < nirep; n++, i++) {
-    result = read_rite_lineno_record(mrb, bin, i, &len);
+    result = read_rite_lineno_record(mrb, bin, i, &len, flags, &fname);
     if (result != MRB_DUMP_OK)
       goto error_exit;
     bin += len;
@@ -305,17 +552,37 @@ error_exit:
 
 
 static int
-read_rite_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc)
+read_rite_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc, uint8_t *flags)
 {
   const struct rite_binary_header *header = (const struct rite_binary_header *)bin;
 
-  if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify)) != 0) {
+  *flags = 0;
+  if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER_LIL, sizeof(header->binary_identify)) == 0) {
+    *flags |= FLAG_BYTEORDER_LIL;
+  }
+  else if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify)) != 0) {
     return MRB_DUMP_INVALID_FILE_HEADER;
   }
 
-  if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version)) != 0) {
+  if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_ISEQ_PADDED | FLAG_POOL_BINARY | FLAG_SYMS_SHARED | FLAG_LINES_PACKED;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_0004, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_ISEQ_PADDED | FLAG_POOL_BINARY | FLAG_SYMS_SHARED;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_0003, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_ISEQ_PADDED | FLAG_POOL_BINARY;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_0002, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_ISEQ_PADDED;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_0001, sizeof(header->binary_version)) != 0 ||
+           (*flags & FLAG_BYTEORDER_LIL)) {
     return MRB_DUMP_INVALID_FILE_HEADER;
   }
+  if (bigendian_p() ? !(*flags & FLAG_BYTEORDER_LIL) : (*flags & FLAG_BYTEORDER_LIL)) {
+    *flags |= FLAG_BYTEORDER_NATIVE;
+  }
 
   *crc = bin_to_uint16(header->binary_crc);
   if (bin_size) {
@@ -325,8 +592,8 @@ read_rite_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc)
   return MRB_DUMP_OK;
 }
 
-int32_t
-mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
+static int32_t
+read_irep(mrb_state *mrb, const uint8_t *bin, struct rite_load_ctx *ctx, uint8_t load_flags)
 {
   int result;
   int32_t total_nirep = 0;
@@ -336,283 +603,199 @@ mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
   size_t n;
   size_t sirep;
 
-  if ((mrb == NULL) || (bin == NULL)) {
-    return MRB_DUMP_INVALID_ARGUMENT;
-  }
-
-  result = read_rite_binary_header(bin, &bin_size, &crc);
+  result = read_rite_binary_header(bin, &bin_size, &crc, &ctx->flags);
   if (result != MRB_DUMP_OK) {
     return result;
   }
 
-  n = offset_crc_body();
-  if (crc != calc_crc_16_ccitt(bin + n, bin_size - n, 0)) {
+  /* the smallest image is a header and the EOF section */
+  if (bin_size < sizeof(struct rite_binary_header) + sizeof(struct rite_binary_footer)) {
     return MRB_DUMP_INVALID_FILE_HEADER;
   }
+  n = sizeof(struct rite_binary_header);
+  if (bin_size >= n + sizeof(struct rite_section_crc32c_header) &&
+      memcmp(bin + n, RITE_SECTION_CRC32C_IDENTIFIER, sizeof(((struct rite_section_header *)0)->section_identify)) == 0) {
+    const struct rite_section_crc32c_header *crc_header = (const struct rite_section_crc32c_header *)(bin + n);
+
+    n += sizeof(struct rite_section_crc32c_header);
+    if (bin_to_uint32(crc_header->crc) != calc_crc_32c(bin + n, bin_size - n, 0)) {
+      return MRB_DUMP_INVALID_FILE_HEADER;
+    }
+  }
+  else {
+    n = offset_crc_body();
+    if (crc != calc_crc_16_ccitt(bin + n, bin_size - n, 0)) {
+      return MRB_DUMP_INVALID_FILE_HEADER;
+    }
+  }
 
   bin += sizeof(struct rite_binary_header);
   sirep = mrb->irep_len;
+  ctx->flags |= load_flags;
 
   do {
     section_header = (const struct rite_section_header *)bin;
     if (memcmp(section_header->section_identify, RITE_SECTION_IREP_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
-      result = read_rite_section_irep(mrb, bin);
+      result = read_rite_section_irep(mrb, bin, ctx);
       if (result < MRB_DUMP_OK) {
-        return result;
+        goto error_exit;
       }
       total_nirep += result;
     }
+    else if (memcmp(section_header->section_identify, RITE_SECTION_SYMS_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
+      result = read_rite_section_syms(mrb, bin, ctx);
+      if (result < MRB_DUMP_OK) {
+        goto error_exit;
+      }
+    }
     else if (memcmp(section_header->section_identify, RITE_SECTION_LINENO_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
-      result = read_rite_section_lineno(mrb, bin, sirep);
+      result = read_rite_section_lineno(mrb, bin, sirep, ctx->flags);
       if (result < MRB_DUMP_OK) {
-        return result;
+        goto error_exit;
       }
     }
     bin += bin_to_uint32(section_header->section_size);
   } while (memcmp(section_header->section_identify, RITE_BINARY_EOF, sizeof(section_header->section_identify)) != 0);
 
-  return total_nirep;
-}
+  if (mrb->irep_len == sirep) {
+    /* no IREP section */
+    return MRB_DUMP_INVALID_IREP;
+  }
+  return total_nirep - sirep + mrb_irep_seal(mrb, sirep);
 
-static void
-irep_error(mrb_state *mrb, int n)
-{
-  static const char msg[] = "irep load error";
-  mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SCRIPT_ERROR, msg, sizeof(msg) - 1));
+error_exit:
+  irep_free(sirep, mrb);
+  return result;
 }
 
-mrb_value
-mrb_load_irep(mrb_state *mrb, const uint8_t *bin)
+int32_t
+mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
 {
-  int32_t n;
+  int32_t result;
+  struct rite_load_ctx ctx = { 0, NULL, 0, NULL };
 
-  n = mrb_read_irep(mrb, bin);
-  if (n < 0) {
-    irep_error(mrb, n);
-    return mrb_nil_value();
+  if ((mrb == NULL) || (bin == NULL)) {
+    return MRB_DUMP_INVALID_ARGUMENT;
   }
-  return mrb_run(mrb, mrb_proc_new(mrb, mrb->irep[n]), mrb_top_self(mrb));
-}
 
-#ifdef ENABLE_STDIO
+  result = read_irep(mrb, bin, &ctx, FLAG_SRC_STATIC);
+  mrb_free(mrb, ctx.syms);
+  return result;
+}
 
-static int32_t
-read_rite_section_lineno_file(mrb_state *mrb, FILE *fp, size_t sirep)
+int32_t
+mrb_read_irep_lazy(mrb_state *mrb, const uint8_t *bin)
 {
   int32_t result;
-  size_t i;
-  uint16_t nirep;
-  uint16_t n;
-  uint32_t len, buf_size;
-  uint8_t *buf = NULL;
-  const size_t record_header_size = 4;
-
-  struct rite_section_lineno_header header;
-  if (fread(&header, sizeof(struct rite_section_lineno_header), 1, fp) == 0) {
-    return MRB_DUMP_READ_FAULT;
-  }
-
-  nirep = bin_to_uint16(header.nirep);
+  struct rite_load_ctx *ctx;
 
-  buf_size = record_header_size;
-  /* We don't need to check buf_size. As it is enough small. */
-  buf = (uint8_t *)mrb_malloc(mrb, buf_size);
-  if (!buf) {
-    result = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
+  if ((mrb == NULL) || (bin == NULL)) {
+    return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  //Read Binary Data Section
-  for (n = 0, i = sirep; n < nirep; n++, i++) {
-    void *ptr;
-
-    if (fread(buf, record_header_size, 1, fp) == 0) {
-      result = MRB_DUMP_READ_FAULT;
-      goto error_exit;
-    }
-    buf_size = bin_to_uint32(&buf[0]);
-    if (SIZE_ERROR(buf_size)) {
-      result = MRB_DUMP_GENERAL_FAILURE;
-      goto error_exit;
-    }
-    ptr = mrb_realloc(mrb, buf, buf_size);
-    if (!ptr) {
-      result = MRB_DUMP_GENERAL_FAILURE;
-      goto error_exit;
-    }
-    buf = (uint8_t *)ptr;
-
-    if (fread(&buf[record_header_size], buf_size - record_header_size, 1, fp) == 0) {
-      result = MRB_DUMP_READ_FAULT;
-      goto error_exit;
-    }
-    result = read_rite_lineno_record(mrb, buf, i, &len);
-    if (result != MRB_DUMP_OK)
-      goto error_exit;
+  ctx = (struct rite_load_ctx *)mrb_calloc(mrb, 1, sizeof(struct rite_load_ctx));
+  if (ctx == NULL) {
+    return MRB_DUMP_GENERAL_FAILURE;
   }
+  result = read_irep(mrb, bin, ctx, FLAG_SRC_STATIC | FLAG_LAZY);
+  /* the top level is decoded now: mrb_run() can only raise, and it
+     has no caller to rescue an error before it starts */
+  if (result >= MRB_DUMP_OK && irep_decode(mrb, mrb->irep[result]) != MRB_DUMP_OK) {
+    mrb_irep *top = mrb->irep[result]->unit;
 
-  result = sirep + bin_to_uint16(header.sirep);
-error_exit:
-  if (buf) {
-    mrb_free(mrb, buf);
+    /* free the unit, which nothing references yet */
+    mrb_irep_incref(top);
+    mrb_irep_decref(mrb, top);
+    result = MRB_DUMP_INVALID_IREP;
   }
   if (result < MRB_DUMP_OK) {
-    irep_free(sirep, mrb);
+    mrb_free(mrb, ctx->syms);
+    mrb_free(mrb, ctx);
+    return result;
   }
+  ctx->next = mrb->irep_images;
+  mrb->irep_images = ctx;
   return result;
 }
 
-static int32_t
-read_rite_section_irep_file(mrb_state *mrb, FILE *fp)
+static void
+irep_error(mrb_state *mrb, int n)
 {
-  int32_t result;
-  size_t sirep;
-  size_t i;
-  uint16_t nirep;
-  uint16_t n;
-  uint32_t len, buf_size;
-  uint8_t *buf = NULL;
-  const size_t record_header_size = 1 + 4;
-  struct rite_section_irep_header header;
-
-  if (fread(&header, sizeof(struct rite_section_irep_header), 1, fp) == 0) {
-    return MRB_DUMP_READ_FAULT;
-  }
+  static const char msg[] = "irep load error";
+  mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SCRIPT_ERROR, msg, sizeof(msg) - 1));
+}
 
-  sirep = mrb->irep_len;
-  nirep = bin_to_uint16(header.nirep);
+mrb_value
+mrb_load_irep(mrb_state *mrb, const uint8_t *bin)
+{
+  int32_t n;
 
-  buf_size = record_header_size;
-  /* You don't need use SIZE_ERROR as buf_size is enough small. */
-  buf = (uint8_t *)mrb_malloc(mrb, buf_size);
-  if (!buf) {
-    result = MRB_DUMP_GENERAL_FAILURE;
-    goto error_exit;
+  n = mrb_read_irep(mrb, bin);
+  if (n < 0) {
+    irep_error(mrb, n);
+    return mrb_nil_value();
   }
+  return mrb_run(mrb, mrb_proc_new(mrb, mrb->irep[n]), mrb_top_self(mrb));
+}
 
-  //Read Binary Data Section
-  for (n = 0, i = sirep; n < nirep; n++, i++) {
-    void *ptr;
-
-    if (fread(buf, record_header_size, 1, fp) == 0) {
-      result = MRB_DUMP_READ_FAULT;
-      goto error_exit;
-    }
-    buf_size = bin_to_uint32(&buf[0]);
-    if (SIZE_ERROR(buf_size)) {
-      result = MRB_DUMP_GENERAL_FAILURE;
-      goto error_exit;
-    }
-    ptr = mrb_realloc(mrb, buf, buf_size);
-    if (!ptr) {
-      result = MRB_DUMP_GENERAL_FAILURE;
-      goto error_exit;
-    }
-    buf = (uint8_t *)ptr;
-
-    if (fread(&buf[record_header_size], buf_size - record_header_size, 1, fp) == 0) {
-      result = MRB_DUMP_READ_FAULT;
-      goto error_exit;
-    }
-    result = read_rite_irep_record(mrb, buf, &len);
-    if (result != MRB_DUMP_OK)
-      goto error_exit;
-  }
+mrb_value
+mrb_load_irep_lazy(mrb_state *mrb, const uint8_t *bin)
+{
+  int32_t n;
 
-  result = sirep + bin_to_uint16(header.sirep);
-error_exit:
-  if (buf) {
-    mrb_free(mrb, buf);
-  }
-  if (result < MRB_DUMP_OK) {
-    irep_free(sirep, mrb);
+  n = mrb_read_irep_lazy(mrb, bin);
+  if (n < 0) {
+    irep_error(mrb, n);
+    return mrb_nil_value();
   }
-  return result;
+  return mrb_run(mrb, mrb_proc_new(mrb, mrb->irep[n]), mrb_top_self(mrb));
 }
 
+#ifdef ENABLE_STDIO
+
+/* reads the whole image with a single fread() and hands it to the
+   in-memory decoder; the buffer is dropped once the ireps are built */
 int32_t
 mrb_read_irep_file(mrb_state *mrb, FILE* fp)
 {
-  int result;
-  int32_t total_nirep = 0;
+  int32_t result;
   uint8_t *buf;
-  uint16_t crc, crcwk = 0;
-  uint32_t section_size = 0;
-  size_t nbytes;
-  size_t sirep;
-  struct rite_section_header section_header;
-  long fpos;
-  const size_t block_size = 1 << 14;
-  const size_t buf_size = sizeof(struct rite_binary_header);
+  uint16_t crc;
+  uint8_t flags = 0;
+  size_t bin_size = 0;
+  struct rite_binary_header header;
+  struct rite_load_ctx ctx = { 0, NULL, 0, NULL };
 
   if ((mrb == NULL) || (fp == NULL)) {
     return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  /* You don't need use SIZE_ERROR as buf_size is enough small. */
-  buf = mrb_malloc(mrb, buf_size);
-  if (!buf) {
-    return MRB_DUMP_GENERAL_FAILURE;
-  }
-  if (fread(buf, buf_size, 1, fp) == 0) {
-    mrb_free(mrb, buf);
+  if (fread(&header, sizeof(struct rite_binary_header), 1, fp) == 0) {
     return MRB_DUMP_READ_FAULT;
   }
-  result = read_rite_binary_header(buf, NULL, &crc);
-  mrb_free(mrb, buf);
+  result = read_rite_binary_header((const uint8_t *)&header, &bin_size, &crc, &flags);
   if (result != MRB_DUMP_OK) {
     return result;
   }
+  if (SIZE_ERROR(bin_size) || bin_size < sizeof(struct rite_binary_header) + sizeof(struct rite_binary_footer)) {
+    return MRB_DUMP_INVALID_FILE_HEADER;
+  }
 
-  /* verify CRC */
-  fpos = ftell(fp);
-  /* You don't need use SIZE_ERROR as block_size is enough small. */
-  buf = mrb_malloc(mrb, block_size);
+  buf = (uint8_t *)mrb_malloc(mrb, bin_size);
   if (!buf) {
     return MRB_DUMP_GENERAL_FAILURE;
   }
-  fseek(fp, offset_crc_body(), SEEK_SET);
-  while ((nbytes = fread(buf, 1, block_size, fp)) > 0) {
-    crcwk = calc_crc_16_ccitt(buf, nbytes, crcwk);
+  memcpy(buf, &header, sizeof(struct rite_binary_header));
+  if (bin_size > sizeof(struct rite_binary_header) &&
+      fread(buf + sizeof(struct rite_binary_header), bin_size - sizeof(struct rite_binary_header), 1, fp) == 0) {
+    result = MRB_DUMP_READ_FAULT;
   }
-  mrb_free(mrb, buf);
-  if (nbytes == 0 && ferror(fp)) {
-    return MRB_DUMP_READ_FAULT;
+  else {
+    result = read_irep(mrb, buf, &ctx, 0);
   }
-  if (crcwk != crc) {
-    return MRB_DUMP_INVALID_FILE_HEADER;
-  }
-  fseek(fp, fpos + section_size, SEEK_SET);
-  sirep = mrb->irep_len;
-
-  // read sections
-  do {
-    fpos = ftell(fp);
-    if (fread(&section_header, sizeof(struct rite_section_header), 1, fp) == 0) {
-      return MRB_DUMP_READ_FAULT;
-    }
-    section_size = bin_to_uint32(section_header.section_size);
-
-    if (memcmp(section_header.section_identify, RITE_SECTION_IREP_IDENTIFIER, sizeof(section_header.section_identify)) == 0) {
-      fseek(fp, fpos, SEEK_SET);
-      result = read_rite_section_irep_file(mrb, fp);
-      if (result < MRB_DUMP_OK) {
-        return result;
-      }
-      total_nirep += result;
-    }
-    else if (memcmp(section_header.section_identify, RITE_SECTION_LINENO_IDENTIFIER, sizeof(section_header.section_identify)) == 0) {
-      fseek(fp, fpos, SEEK_SET);
-      result = read_rite_section_lineno_file(mrb, fp, sirep);
-      if (result < MRB_DUMP_OK) {
-        return result;
-      }
-    }
-
-    fseek(fp, fpos + section_size, SEEK_SET);
-  } while (memcmp(section_header.section_identify, RITE_BINARY_EOF, sizeof(section_header.section_identify)) != 0);
-
-  return total_nirep;
+  mrb_free(mrb, buf);
+  mrb_free(mrb, ctx.syms);
+  return result;
 }
 
 mrb_value
@@ -488,6 +488,9 @@ mrb_obj_is_kind_of(mrb_state *mrb, mrb_value obj, struct RClass *c)
       mrb_raise(mrb, E_TYPE_ERROR, "class or module required");
   }
 
+  if (c->tt == MRB_TT_CLASS) {
+    return mrb_class_inherit_p(mrb, cl, c);
+  }
   while (cl) {
     if (cl == c || cl->mt == c->mt)
       return TRUE;
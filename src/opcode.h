@@ -137,6 +137,16 @@ OP_DEBUG,/*     A       print R(A)                                      */
 OP_STOP,/*              stop VM                                         */
 OP_ERR,/*       Bx      raise RuntimeError with message Lit(Bx)         */
 
+OP_MOD,/*       A B C   R(A) := R(A)%R(A+1) (mSyms[B]=:%,C=1)           */
+OP_SHL,/*       A B C   R(A) := R(A)<<R(A+1) (mSyms[B]=:<<,C=1)         */
+OP_SHR,/*       A B C   R(A) := R(A)>>R(A+1) (mSyms[B]=:>>,C=1)         */
+OP_BAND,/*      A B C   R(A) := R(A)&R(A+1) (mSyms[B]=:&,C=1)           */
+OP_BOR,/*       A B C   R(A) := R(A)|R(A+1) (mSyms[B]=:|,C=1)           */
+OP_BXOR,/*      A B C   R(A) := R(A)^R(A+1) (mSyms[B]=:^,C=1)           */
+OP_NEG,/*       A B C   R(A) := -R(A) (mSyms[B]=:-@,C=0)                */
+OP_GETIDX,/*    A B C   R(A) := R(A)[R(A+1)] (mSyms[B]=:[],C=1)         */
+OP_SETIDX,/*    A B C   R(A) := R(A)[R(A+1)]=R(A+2) (mSyms[B]=:[]=,C=2) */
+
 OP_RSVD1,/*             reserved instruction #1                         */
 OP_RSVD2,/*             reserved instruction #2                         */
 OP_RSVD3,/*             reserved instruction #3                         */
@@ -23,6 +23,7 @@
 #include <string.h>
 #include "mruby.h"
 #include "mruby/compile.h"
+#include "mruby/irep.h"
 #include "mruby/proc.h"
 #include "node.h"
 
@@ -5183,14 +5184,16 @@ mrb_parse_string(mrb_state *mrb, const char *s, mrbc_context *c)
   return mrb_parse_nstring(mrb, s, strlen(s), c);
 }
 
-static mrb_value
-load_exec(mrb_state *mrb, parser_state *p, mrbc_context *c)
+/* compiles a parsed program into the irep index returned; on failure
+   returns -1 with the value of the load in *v */
+static int
+load_generate(mrb_state *mrb, parser_state *p, mrb_value *v)
 {
   int n;
-  mrb_value v;
 
+  *v = mrb_undef_value();
   if (!p) {
-    return mrb_undef_value();
+    return -1;
   }
   if (!p->tree || p->nerr) {
     if (p->capture_errors) {
@@ -5200,13 +5203,13 @@ load_exec(mrb_state *mrb, parser_state *p, mrbc_context *c)
       p->error_buffer[0].lineno, p->error_buffer[0].message);
       mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SYNTAX_ERROR, buf, n));
       mrb_parser_free(p);
-      return mrb_undef_value();
+      return -1;
     }
     else {
       static const char msg[] = "syntax error";
       mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SYNTAX_ERROR, msg, sizeof(msg) - 1));
       mrb_parser_free(p);
-      return mrb_undef_value();
+      return -1;
     }
   }
   n = mrb_generate_code(mrb, p);
@@ -5214,8 +5217,17 @@ load_exec(mrb_state *mrb, parser_state *p, mrbc_context *c)
   if (n < 0) {
     static const char msg[] = "codegen error";
     mrb->exc = mrb_obj_ptr(mrb_exc_new(mrb, E_SCRIPT_ERROR, msg, sizeof(msg) - 1));
-    return mrb_nil_value();
+    *v = mrb_nil_value();
+    return -1;
   }
+  return n;
+}
+
+static mrb_value
+load_run(mrb_state *mrb, int n, mrbc_context *c)
+{
+  mrb_value v;
+
   if (c) {
     if (c->dump_result) codedump_all(mrb, n);
     if (c->no_exec) return mrb_fixnum_value(n);
@@ -5225,6 +5237,16 @@ load_exec(mrb_state *mrb, parser_state *p, mrbc_context *c)
   return v;
 }
 
+static mrb_value
+load_exec(mrb_state *mrb, parser_state *p, mrbc_context *c)
+{
+  mrb_value v;
+  int n = load_generate(mrb, p, &v);
+
+  if (n < 0) return v;
+  return load_run(mrb, n, c);
+}
+
 #ifdef ENABLE_STDIO
 mrb_value
 mrb_load_file_cxt(mrb_state *mrb, FILE *f, mrbc_context *c)
@@ -5239,10 +5261,38 @@ mrb_load_file(mrb_state *mrb, FILE *f)
 }
 #endif
 
+mrb_irep *mrb_code_cache_get(mrb_state*, const char*, size_t, mrbc_context*);
+void mrb_code_cache_put(mrb_state*, const char*, size_t, mrbc_context*, const mrb_sym*, int, mrb_irep*);
+
 mrb_value
 mrb_load_nstring_cxt(mrb_state *mrb, const char *s, int len, mrbc_context *c)
 {
-  return load_exec(mrb, mrb_parse_nstring(mrb, s, len, c), c);
+  mrb_irep *irep;
+  mrb_sym *syms = NULL;
+  int slen = 0;
+  mrb_value v;
+  int n;
+
+  if (!mrb->code_cache) {
+    return load_exec(mrb, mrb_parse_nstring(mrb, s, len, c), c);
+  }
+  irep = mrb_code_cache_get(mrb, s, len, c);
+  if (irep) {
+    return load_run(mrb, irep->idx, c);
+  }
+  /* the parse replaces the locals of the context, which key the entry */
+  if (c && c->slen > 0) {
+    slen = c->slen;
+    syms = (mrb_sym *)mrb_malloc(mrb, sizeof(mrb_sym) * slen);
+    memcpy(syms, c->syms, sizeof(mrb_sym) * slen);
+  }
+  n = load_generate(mrb, mrb_parse_nstring(mrb, s, len, c), &v);
+  if (n >= 0) {
+    mrb_code_cache_put(mrb, s, len, c, syms, slen, mrb->irep[n]);
+  }
+  mrb_free(mrb, syms);
+  if (n < 0) return v;
+  return load_run(mrb, n, c);
 }
 
 mrb_value
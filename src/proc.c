@@ -6,6 +6,7 @@
 
 #include "mruby.h"
 #include "mruby/class.h"
+#include "mruby/irep.h"
 #include "mruby/proc.h"
 #include "opcode.h"
 
@@ -22,6 +23,7 @@ mrb_proc_new(mrb_state *mrb, mrb_irep *irep)
   p->target_class = (mrb->ci) ? mrb->ci->target_class : 0;
   p->body.irep = irep;
   p->env = 0;
+  if (irep) mrb_irep_incref(irep);
 
   return p;
 }
@@ -76,8 +78,11 @@ mrb_closure_new_cfunc(mrb_state *mrb, mrb_func_t func, int nlocals)
 }
 
 void
-mrb_proc_copy(struct RProc *a, struct RProc *b)
+mrb_proc_copy(mrb_state *mrb, struct RProc *a, struct RProc *b)
 {
+  /* take b's reference first: a and b may share a unit */
+  if (!MRB_PROC_CFUNC_P(b) && b->body.irep) mrb_irep_incref(b->body.irep);
+  if (!MRB_PROC_CFUNC_P(a) && a->body.irep) mrb_irep_decref(mrb, a->body.irep);
   a->flags = b->flags;
   a->body = b->body;
   a->target_class = b->target_class;
@@ -95,7 +100,7 @@ mrb_proc_initialize(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_ARGUMENT_ERROR, "tried to create Proc object without a block");
   }
   else {
-    mrb_proc_copy(mrb_proc_ptr(self), mrb_proc_ptr(blk));
+    mrb_proc_copy(mrb, mrb_proc_ptr(self), mrb_proc_ptr(blk));
   }
   return self;
 }
@@ -109,7 +114,7 @@ mrb_proc_init_copy(mrb_state *mrb, mrb_value self)
   if (mrb_type(proc) != MRB_TT_PROC) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "not a proc");
   }
-  mrb_proc_copy(mrb_proc_ptr(self), mrb_proc_ptr(proc));
+  mrb_proc_copy(mrb, mrb_proc_ptr(self), mrb_proc_ptr(proc));
   return self;
 }
 
@@ -122,12 +127,13 @@ mrb_proc_cfunc_p(struct RProc *p)
 mrb_value
 mrb_proc_call_cfunc(mrb_state *mrb, struct RProc *p, mrb_value self)
 {
-  return (p->body.func)(mrb, self);
+  return MRB_PROC_CFUNC_CALL(mrb, p, self);
 }
 
 mrb_code*
 mrb_proc_iseq(mrb_state *mrb, struct RProc *p)
 {
+  mrb_irep_materialize(mrb, p->body.irep);
   return p->body.irep->iseq;
 }
 
@@ -170,7 +176,7 @@ proc_lambda(mrb_state *mrb, mrb_value self)
   p = mrb_proc_ptr(blk);
   if (!MRB_PROC_STRICT_P(p)) {
     struct RProc *p2 = (struct RProc*)mrb_obj_alloc(mrb, MRB_TT_PROC, p->c);
-    mrb_proc_copy(p2, p);
+    mrb_proc_copy(mrb, p2, p);
     p2->flags |= MRB_PROC_STRICT;
     return mrb_obj_value(p2);
   }
@@ -8,6 +8,7 @@
 #include <string.h>
 #include "mruby.h"
 #include "mruby/class.h"
+#include "mruby/compile.h"
 #include "mruby/irep.h"
 #include "mruby/variable.h"
 
@@ -35,6 +36,9 @@ mrb_open_allocf(mrb_allocf f, void *ud)
 
   mrb_init_heap(mrb);
   mrb_init_core(mrb);
+#ifdef MRB_CODE_CACHE_SIZE
+  mrb_code_cache_set_capacity(mrb, MRB_CODE_CACHE_SIZE);
+#endif
   return mrb;
 }
 
@@ -92,6 +96,9 @@ mrb_open(void)
 }
 
 void mrb_free_symtbl(mrb_state *mrb);
+void mrb_free_irep_images(mrb_state *mrb);
+void mrb_free_archives(mrb_state *mrb);
+void mrb_free_code_cache(mrb_state *mrb);
 void mrb_free_heap(mrb_state *mrb);
 
 void
@@ -101,7 +108,8 @@ mrb_irep_free(mrb_state *mrb, struct mrb_irep *irep)
     mrb_free(mrb, irep->iseq);
   mrb_free(mrb, irep->pool);
   mrb_free(mrb, irep->syms);
-  mrb_free(mrb, irep->lines);
+  if (!(irep->flags & MRB_LINES_NO_FREE))
+    mrb_free(mrb, (void *)irep->line_table);
   mrb_free(mrb, irep);
 }
 
@@ -116,14 +124,20 @@ mrb_close(mrb_state *mrb)
   mrb_gc_free_gv(mrb);
   mrb_free(mrb, mrb->stbase);
   mrb_free(mrb, mrb->cibase);
+  /* procs release their ireps */
+  mrb_free_heap(mrb);
+  mrb_free_code_cache(mrb);
   for (i=0; i<mrb->irep_len; i++) {
-    mrb_irep_free(mrb, mrb->irep[i]);
+    if (mrb->irep[i])
+      mrb_irep_free(mrb, mrb->irep[i]);
   }
   mrb_free(mrb, mrb->irep);
+  mrb_free_irep_images(mrb);
+  mrb_free_archives(mrb);
   mrb_free(mrb, mrb->rescue);
   mrb_free(mrb, mrb->ensure);
   mrb_free_symtbl(mrb);
-  mrb_free_heap(mrb);
+  mrb_free_class_displays(mrb);
   mrb_alloca_free(mrb);
   mrb_free(mrb, mrb);
 }
@@ -164,6 +178,172 @@ mrb_add_irep(mrb_state *mrb)
   return irep;
 }
 
+/* first index of a run of n free slots below start, or start when
+   there is none; a shorter run ending at start still lets the unit
+   slide down */
+static size_t
+irep_find_hole(mrb_state *mrb, size_t start, size_t n)
+{
+  size_t i, run = 0;
+
+  if (mrb->irep_free == 0) return start;
+  for (i = 0; i < start; i++) {
+    if (mrb->irep[i]) {
+      run = 0;
+    }
+    else if (++run == n) {
+      return i + 1 - n;
+    }
+  }
+  return start - run;
+}
+
+size_t
+mrb_irep_seal(mrb_state *mrb, size_t start)
+{
+  size_t n = mrb->irep_len - start;
+  size_t hole, i;
+  mrb_irep *top;
+
+  if (n == 0) return start;
+  hole = irep_find_hole(mrb, start, n);
+  if (hole < start) {
+    size_t filled = start - hole < n ? start - hole : n;
+
+    memmove(&mrb->irep[hole], &mrb->irep[start], sizeof(mrb_irep*) * n);
+    for (i = hole + n > start ? hole + n : start; i < start + n; i++) {
+      mrb->irep[i] = NULL;
+    }
+    mrb->irep_free -= filled;
+    mrb->irep_len = hole + n > start ? hole + n : start;
+    while (mrb->irep_len > 0 && !mrb->irep[mrb->irep_len - 1]) {
+      mrb->irep_len--;
+      mrb->irep_free--;
+    }
+    if (mrb->irep_old_len > mrb->irep_len) {
+      mrb->irep_old_len = mrb->irep_len;
+    }
+  }
+  top = mrb->irep[hole];
+  for (i = 0; i < n; i++) {
+    mrb->irep[hole + i]->idx = (uint32_t)(hole + i);
+    mrb->irep[hole + i]->unit = top;
+  }
+  top->refcnt = 0;
+  top->unit_len = (uint32_t)n;
+  /* pools below irep_old_len are not marked by minor GCs */
+  mrb_irep_pool_barrier(mrb, top);
+  return hole;
+}
+
+void
+mrb_irep_decref(mrb_state *mrb, mrb_irep *irep)
+{
+  mrb_irep *top = irep->unit;
+  size_t start, n, i;
+
+  if (!top || top->refcnt == 0 || --top->refcnt > 0) return;
+  start = top->idx;
+  n = top->unit_len;
+  for (i = start; i < start + n; i++) {
+    mrb_irep_free(mrb, mrb->irep[i]);
+    mrb->irep[i] = NULL;
+  }
+  mrb->irep_free += n;
+}
+
+static size_t
+leb128_put(uint32_t v, uint8_t *p)
+{
+  size_t n = 1;
+
+  while (v >= 0x80) {
+    if (p) *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+    n++;
+  }
+  if (p) *p = (uint8_t)v;
+  return n;
+}
+
+static uint32_t
+leb128_get(const uint8_t **pp)
+{
+  const uint8_t *p = *pp;
+  uint32_t v = 0;
+  int shift = 0;
+
+  do {
+    v |= (uint32_t)(*p & 0x7f) << shift;
+    shift += 7;
+  } while ((*p++ & 0x80) && shift < 32);
+  *pp = p;
+  return v;
+}
+
+static size_t
+line_runs_put(const uint16_t *lines, size_t n, uint8_t *p)
+{
+  size_t i = 0, run, size = 0;
+  int32_t prev = 0, delta;
+
+  while (i < n) {
+    for (run = 1; i + run < n && lines[i + run] == lines[i]; run++)
+      ;
+    delta = (int32_t)lines[i] - prev;
+    size += leb128_put((uint32_t)run, p ? p + size : NULL);
+    size += leb128_put(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31), p ? p + size : NULL);
+    prev = lines[i];
+    i += run;
+  }
+  return size;
+}
+
+/* packs one line number per instruction into runs; NULL when n is 0 */
+uint8_t*
+mrb_irep_line_table(mrb_state *mrb, const uint16_t *lines, size_t n)
+{
+  uint8_t *table;
+
+  if (n == 0) return NULL;
+  table = (uint8_t *)mrb_malloc(mrb, line_runs_put(lines, n, NULL));
+  line_runs_put(lines, n, table);
+  return table;
+}
+
+size_t
+mrb_irep_line_table_size(const uint8_t *table, size_t ilen)
+{
+  const uint8_t *p = table;
+  size_t pc = 0;
+
+  if (!table) return 0;
+  while (pc < ilen) {
+    pc += leb128_get(&p);
+    leb128_get(&p);
+  }
+  return p - table;
+}
+
+/* line number of the instruction at pc, or -1 without debug info */
+int32_t
+mrb_irep_line(const mrb_irep *irep, size_t pc)
+{
+  const uint8_t *p = irep->line_table;
+  size_t end = 0;
+  uint32_t z;
+  int32_t line = 0;
+
+  if (!p) return -1;
+  for (;;) {
+    end += leb128_get(&p);
+    z = leb128_get(&p);
+    line += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    if (pc < end) return line;
+    if (end >= irep->ilen) return -1;
+  }
+}
+
 mrb_value
 mrb_top_self(mrb_state *mrb)
 {
@@ -30,14 +30,11 @@ typedef struct mrb_shared_string {
   mrb_int len;
 } mrb_shared_string;
 
-#define MRB_STR_SHARED    1
-#define MRB_STR_NOFREE    2
-
 static mrb_value str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2);
 static mrb_value mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len);
 
 #define RESIZE_CAPA(s,capacity) do {\
-      s->ptr = (char *)mrb_realloc(mrb, s->ptr, (capacity)+1);\
+      s->ptr = (char *)mrb_realloc_tt(mrb, s->ptr, (capacity)+1, MRB_TT_STRING);\
       s->aux.capa = capacity;\
 } while(0)
 
@@ -70,7 +67,7 @@ mrb_str_modify(mrb_state *mrb, struct RString *s)
 
       p = s->ptr;
       len = s->len;
-      ptr = (char *)mrb_malloc(mrb, (size_t)len + 1);
+      ptr = (char *)mrb_realloc_tt(mrb, 0, (size_t)len + 1, MRB_TT_STRING);
       if (p) {
         memcpy(ptr, p, len);
       }
@@ -85,7 +82,7 @@ mrb_str_modify(mrb_state *mrb, struct RString *s)
   if (s->flags & MRB_STR_NOFREE) {
     char *p = s->ptr;
 
-    s->ptr = (char *)mrb_malloc(mrb, (size_t)s->len+1);
+    s->ptr = (char *)mrb_realloc_tt(mrb, 0, (size_t)s->len+1, MRB_TT_STRING);
     if (p) {
       memcpy(s->ptr, p, s->len);
     }
@@ -105,7 +102,7 @@ mrb_str_resize(mrb_state *mrb, mrb_value str, mrb_int len)
   slen = s->len;
   if (len != slen) {
     if (slen < len || slen -len > 1024) {
-      s->ptr = (char *)mrb_realloc(mrb, s->ptr, len+1);
+      s->ptr = (char *)mrb_realloc_tt(mrb, s->ptr, len+1, MRB_TT_STRING);
     }
     s->aux.capa = len;
     s->len = len;
@@ -141,7 +138,7 @@ str_new(mrb_state *mrb, const char *p, mrb_int len)
   s = mrb_obj_alloc_string(mrb);
   s->len = len;
   s->aux.capa = len;
-  s->ptr = (char *)mrb_malloc(mrb, (size_t)len+1);
+  s->ptr = (char *)mrb_realloc_tt(mrb, 0, (size_t)len+1, MRB_TT_STRING);
   if (p) {
     memcpy(s->ptr, p, len);
   }
@@ -180,7 +177,7 @@ mrb_str_buf_new(mrb_state *mrb, mrb_int capa)
   }
   s->len = 0;
   s->aux.capa = capa;
-  s->ptr = (char *)mrb_malloc(mrb, capa+1);
+  s->ptr = (char *)mrb_realloc_tt(mrb, 0, capa+1, MRB_TT_STRING);
   s->ptr[0] = '\0';
 
   return mrb_obj_value(s);
@@ -262,7 +259,7 @@ mrb_str_new_cstr(mrb_state *mrb, const char *p)
   }
 
   s = mrb_obj_alloc_string(mrb);
-  s->ptr = (char *)mrb_malloc(mrb, len+1);
+  s->ptr = (char *)mrb_realloc_tt(mrb, 0, len+1, MRB_TT_STRING);
   if (p) {
     memcpy(s->ptr, p, len);
   }
@@ -326,7 +323,7 @@ str_make_shared(mrb_state *mrb, struct RString *s)
     else {
       shared->nofree = FALSE;
       if (s->aux.capa > s->len) {
-        s->ptr = shared->ptr = (char *)mrb_realloc(mrb, s->ptr, s->len+1);
+        s->ptr = shared->ptr = (char *)mrb_realloc_tt(mrb, s->ptr, s->len+1, MRB_TT_STRING);
       }
       else {
         shared->ptr = s->ptr;
@@ -402,7 +399,7 @@ mrb_str_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 
   if (s1->aux.capa < len) {
     s1->aux.capa = len;
-    s1->ptr = (char *)mrb_realloc(mrb, s1->ptr, len+1);
+    s1->ptr = (char *)mrb_realloc_tt(mrb, s1->ptr, len+1, MRB_TT_STRING);
   }
   memcpy(s1->ptr+s1->len, s2->ptr, s2->len);
   s1->len = len;
@@ -438,14 +435,13 @@ mrb_str_plus(mrb_state *mrb, mrb_value a, mrb_value b)
  *  Returns a new string object containing a copy of <i>str</i>.
  */
 static mrb_value
-mrb_str_plus_m(mrb_state *mrb, mrb_value self)
+mrb_str_plus_m(mrb_state *mrb, mrb_value self, mrb_arg *argv, int argc)
 {
-  mrb_value str;
-
-  mrb_get_args(mrb, "S", &str);
-  return mrb_str_plus(mrb, self, str);
+  return mrb_str_plus(mrb, self, argv[0].v);
 }
 
+static const mrb_argspec str_plus_spec = MRB_ARGSPEC(mrb_str_plus_m, 1, 0, 0, 0, mrb_argconv_str);
+
 /*
  *  call-seq:
  *     len = strlen(String("abcd"))
@@ -1407,10 +1403,10 @@ str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2)
     if (s1->flags & MRB_STR_SHARED) {
       str_decref(mrb, s1->aux.shared);
       s1->flags &= ~MRB_STR_SHARED;
-      s1->ptr = (char *)mrb_malloc(mrb, s2->len+1);
+      s1->ptr = (char *)mrb_realloc_tt(mrb, 0, s2->len+1, MRB_TT_STRING);
     }
     else {
-      s1->ptr = (char *)mrb_realloc(mrb, s1->ptr, s2->len+1);
+      s1->ptr = (char *)mrb_realloc_tt(mrb, s1->ptr, s2->len+1, MRB_TT_STRING);
     }
     memcpy(s1->ptr, s2->ptr, s2->len);
     s1->ptr[s2->len] = 0;
@@ -2535,10 +2531,10 @@ mrb_init_string(mrb_state *mrb)
   MRB_SET_INSTANCE_TT(s, MRB_TT_STRING);
   mrb_include_module(mrb, s, mrb_class_get(mrb, "Comparable"));
 
-  mrb_define_method(mrb, s, "+",               mrb_str_plus_m,          MRB_ARGS_REQ(1)); /* 15.2.10.5.2  */
+  mrb_define_method_spec(mrb, s, "+",          &str_plus_spec);                      /* 15.2.10.5.2  */
   mrb_define_method(mrb, s, "bytesize",        mrb_str_bytesize,        MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "size",            mrb_str_size,            MRB_ARGS_NONE()); /* 15.2.10.5.33 */
-  mrb_define_method(mrb, s, "length",          mrb_str_size,            MRB_ARGS_NONE()); /* 15.2.10.5.26 */
+  mrb_define_leaf_method(mrb, s, "size",            mrb_str_size);                        /* 15.2.10.5.33 */
+  mrb_define_leaf_method(mrb, s, "length",          mrb_str_size);                        /* 15.2.10.5.26 */
   mrb_define_method(mrb, s, "*",               mrb_str_times,           MRB_ARGS_REQ(1)); /* 15.2.10.5.1  */
   mrb_define_method(mrb, s, "<=>",             mrb_str_cmp_m,           MRB_ARGS_REQ(1)); /* 15.2.10.5.3  */
   mrb_define_method(mrb, s, "==",              mrb_str_equal_m,         MRB_ARGS_REQ(1)); /* 15.2.10.5.4  */
@@ -2552,7 +2548,7 @@ mrb_init_string(mrb_state *mrb)
   mrb_define_method(mrb, s, "chop!",           mrb_str_chop_bang,       MRB_ARGS_REQ(1)); /* 15.2.10.5.12 */
   mrb_define_method(mrb, s, "downcase",        mrb_str_downcase,        MRB_ARGS_NONE()); /* 15.2.10.5.13 */
   mrb_define_method(mrb, s, "downcase!",       mrb_str_downcase_bang,   MRB_ARGS_NONE()); /* 15.2.10.5.14 */
-  mrb_define_method(mrb, s, "empty?",          mrb_str_empty_p,         MRB_ARGS_NONE()); /* 15.2.10.5.16 */
+  mrb_define_leaf_method(mrb, s, "empty?",          mrb_str_empty_p);                     /* 15.2.10.5.16 */
   mrb_define_method(mrb, s, "eql?",            mrb_str_eql,             MRB_ARGS_REQ(1)); /* 15.2.10.5.17 */
 
   // NOTE: Regexp not implemented
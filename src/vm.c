@@ -8,6 +8,7 @@
 #include <setjmp.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
@@ -375,7 +376,7 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, int argc, mr
 
     if (MRB_PROC_CFUNC_P(p)) {
       int ai = mrb_gc_arena_save(mrb);
-      val = p->body.func(mrb, self);
+      val = MRB_PROC_CFUNC_CALL(mrb, p, self);
       mrb_gc_arena_restore(mrb, ai);
       mrb_gc_protect(mrb, val);
       mrb->stack = mrb->stbase + mrb->ci->stackidx;
@@ -430,7 +431,7 @@ mrb_yield_internal(mrb_state *mrb, mrb_value b, int argc, mrb_value *argv, mrb_v
   mrb->stack[argc+1] = mrb_nil_value();
 
   if (MRB_PROC_CFUNC_P(p)) {
-    val = p->body.func(mrb, self);
+    val = MRB_PROC_CFUNC_CALL(mrb, p, self);
     mrb->stack = mrb->stbase + mrb->ci->stackidx;
     cipop(mrb);
   }
@@ -536,14 +537,16 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
 {
   /* assert(mrb_proc_cfunc_p(proc)) */
   mrb_irep *irep = proc->body.irep;
-  mrb_code *pc = irep->iseq;
-  mrb_value *pool = irep->pool;
-  mrb_sym *syms = irep->syms;
+  mrb_code *pc = NULL;
+  mrb_value *pool;
+  mrb_sym *syms;
   mrb_value *regs = NULL;
   mrb_code i;
   int ai = mrb_gc_arena_save(mrb);
   jmp_buf *prev_jmp = (jmp_buf *)mrb->jmp;
   jmp_buf c_jmp;
+  /* ensure clauses below this belong to the frames we were called from */
+  int base_eidx = mrb->ci ? mrb->ci->eidx : 0;
 
 #ifdef DIRECT_THREADED
   static void *optable[] = {
@@ -567,16 +570,22 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
     &&L_OP_CLASS, &&L_OP_MODULE, &&L_OP_EXEC,
     &&L_OP_METHOD, &&L_OP_SCLASS, &&L_OP_TCLASS,
     &&L_OP_DEBUG, &&L_OP_STOP, &&L_OP_ERR,
+    &&L_OP_MOD, &&L_OP_SHL, &&L_OP_SHR, &&L_OP_BAND, &&L_OP_BOR, &&L_OP_BXOR,
+    &&L_OP_NEG, &&L_OP_GETIDX, &&L_OP_SETIDX,
   };
 #endif
 
-
   if (setjmp(c_jmp) == 0) {
     mrb->jmp = &c_jmp;
   }
   else {
     goto L_RAISE;
   }
+  /* may raise; L_RAISE needs the jmp_buf */
+  mrb_irep_materialize(mrb, irep);
+  pc = irep->iseq;
+  pool = irep->pool;
+  syms = irep->syms;
   if (!mrb->stack) {
     stack_init(mrb);
   }
@@ -875,6 +884,12 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
           regs[a+1] = sym;
         }
       }
+      else if (n == 0 && MRB_PROC_LEAF_P(m)) {
+        /* leaf C function; no callinfo frame needed */
+        regs[a] = m->body.func(mrb, recv);
+        mrb_gc_arena_restore(mrb, ai);
+        NEXT;
+      }
 
       /* push callinfo */
       ci = cipush(mrb);
@@ -907,7 +922,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
         else {
           ci->nregs = n + 2;
         }
-        result = m->body.func(mrb, recv);
+        result = MRB_PROC_CFUNC_CALL(mrb, m, recv);
         mrb->stack[0] = result;
         mrb_gc_arena_restore(mrb, ai);
         if (mrb->exc) goto L_RAISE;
@@ -920,6 +935,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
         /* setup environment for calling method */
         proc = mrb->ci->proc = m;
         irep = m->body.irep;
+        mrb_irep_materialize(mrb, irep);
         pool = irep->pool;
         syms = irep->syms;
         ci->nregs = irep->nregs;
@@ -961,7 +977,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
 
       /* prepare stack */
       if (MRB_PROC_CFUNC_P(m)) {
-        recv = m->body.func(mrb, recv);
+        recv = MRB_PROC_CFUNC_CALL(mrb, m, recv);
         mrb_gc_arena_restore(mrb, ai);
         if (mrb->exc) goto L_RAISE;
         /* pop stackpos */
@@ -983,6 +999,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
           mrb->stack[0] = mrb_nil_value();
           goto L_RETURN;
         }
+        mrb_irep_materialize(mrb, irep);
         pool = irep->pool;
         syms = irep->syms;
         ci->nregs = irep->nregs;
@@ -1043,7 +1060,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       mrb->stack[0] = recv;
 
       if (MRB_PROC_CFUNC_P(m)) {
-        mrb->stack[0] = m->body.func(mrb, recv);
+        mrb->stack[0] = MRB_PROC_CFUNC_CALL(mrb, m, recv);
         mrb_gc_arena_restore(mrb, ai);
         if (mrb->exc) goto L_RAISE;
         /* pop stackpos */
@@ -1058,6 +1075,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
         /* setup environment for calling method */
         ci->proc = m;
         irep = m->body.irep;
+        mrb_irep_materialize(mrb, irep);
         pool = irep->pool;
         syms = irep->syms;
         ci->nregs = irep->nregs;
@@ -1361,13 +1379,14 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       value_move(mrb->stack, &regs[a], ci->argc+1);
 
       if (MRB_PROC_CFUNC_P(m)) {
-        mrb->stack[0] = m->body.func(mrb, recv);
+        mrb->stack[0] = MRB_PROC_CFUNC_CALL(mrb, m, recv);
         mrb_gc_arena_restore(mrb, ai);
         goto L_RETURN;
       }
       else {
         /* setup environment for calling method */
         irep = m->body.irep;
+        mrb_irep_materialize(mrb, irep);
         pool = irep->pool;
         syms = irep->syms;
         if (ci->argc < 0) {
@@ -1705,6 +1724,181 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       NEXT;
     }
 
+#define FIXNUM_BOP_P(mrb) (((mrb)->bop_redefined & MRB_BOP_FIXNUM) == 0)
+
+    CASE(OP_MOD) {
+      /* A B C  R(A) := R(A)%R(A+1) (Syms[B]=:%,C=1)*/
+      int a = GETARG_A(i);
+
+      if (TYPES2(mrb_type(regs[a]),mrb_type(regs[a+1])) == TYPES2(MRB_TT_FIXNUM,MRB_TT_FIXNUM) &&
+          FIXNUM_BOP_P(mrb)) {
+        mrb_int x = mrb_fixnum(regs[a]);
+        mrb_int y = mrb_fixnum(regs[a+1]);
+        mrb_int z;
+
+        if (y == 0) goto L_SEND;  /* let Fixnum#% produce NaN */
+        if (y == -1) {
+          z = 0;                  /* avoid MRB_INT_MIN % -1 overflow */
+        }
+        else {
+          z = x % y;
+          if (z != 0 && (z < 0) != (y < 0)) z += y;
+        }
+        SET_INT_VALUE(regs[a], z);
+        NEXT;
+      }
+      goto L_SEND;
+    }
+
+    CASE(OP_SHL) {
+      /* A B C  R(A) := R(A)<<R(A+1) (Syms[B]=:<<,C=1)*/
+      int a = GETARG_A(i);
+
+      if (TYPES2(mrb_type(regs[a]),mrb_type(regs[a+1])) == TYPES2(MRB_TT_FIXNUM,MRB_TT_FIXNUM) &&
+          FIXNUM_BOP_P(mrb)) {
+        mrb_int width = mrb_fixnum(regs[a+1]);
+
+        /* out of range widths raise or shift the other way in Fixnum#<< */
+        if (width >= 0 && width <= (mrb_int)(sizeof(mrb_int)*CHAR_BIT-1)) {
+          regs[a].attr_i = mrb_fixnum(regs[a]) << width;
+          NEXT;
+        }
+      }
+      goto L_SEND;
+    }
+
+    CASE(OP_SHR) {
+      /* A B C  R(A) := R(A)>>R(A+1) (Syms[B]=:>>,C=1)*/
+      int a = GETARG_A(i);
+
+      if (TYPES2(mrb_type(regs[a]),mrb_type(regs[a+1])) == TYPES2(MRB_TT_FIXNUM,MRB_TT_FIXNUM) &&
+          FIXNUM_BOP_P(mrb)) {
+        mrb_int x = mrb_fixnum(regs[a]);
+        mrb_int width = mrb_fixnum(regs[a+1]);
+
+        if (width >= 0) {
+          if (width >= (mrb_int)(sizeof(mrb_int)*CHAR_BIT-1)) {
+            regs[a].attr_i = (x < 0) ? -1 : 0;
+          }
+          else {
+            regs[a].attr_i = x >> width;
+          }
+          NEXT;
+        }
+      }
+      goto L_SEND;
+    }
+
+#define OP_BIT(op) do {\
+  int a = GETARG_A(i);\
+  if (TYPES2(mrb_type(regs[a]),mrb_type(regs[a+1])) != TYPES2(MRB_TT_FIXNUM,MRB_TT_FIXNUM) ||\
+      !FIXNUM_BOP_P(mrb)) {\
+    goto L_SEND;\
+  }\
+  regs[a].attr_i = regs[a].attr_i op regs[a+1].attr_i;\
+} while(0)
+
+    CASE(OP_BAND) {
+      /* A B C  R(A) := R(A)&R(A+1) (Syms[B]=:&,C=1)*/
+      OP_BIT(&);
+      NEXT;
+    }
+
+    CASE(OP_BOR) {
+      /* A B C  R(A) := R(A)|R(A+1) (Syms[B]=:|,C=1)*/
+      OP_BIT(|);
+      NEXT;
+    }
+
+    CASE(OP_BXOR) {
+      /* A B C  R(A) := R(A)^R(A+1) (Syms[B]=:^,C=1)*/
+      OP_BIT(^);
+      NEXT;
+    }
+
+    CASE(OP_NEG) {
+      /* A B C  R(A) := -R(A) (Syms[B]=:-@,C=0)*/
+      int a = GETARG_A(i);
+
+      if (mrb_fixnum_p(regs[a]) && FIXNUM_BOP_P(mrb)) {
+        regs[a].attr_i = 0 - regs[a].attr_i;
+        NEXT;
+      }
+      goto L_SEND;
+    }
+
+#define BOP_RECV_P(mrb,v,klass,flag) \
+  (mrb_obj_ptr(v)->c == (mrb)->klass && ((mrb)->bop_redefined & (flag)) == 0)
+
+    CASE(OP_GETIDX) {
+      /* A B C  R(A) := R(A)[R(A+1)] (Syms[B]=:[],C=1)*/
+      int a = GETARG_A(i);
+      mrb_value recv = regs[a];
+      mrb_value idx = regs[a+1];
+      mrb_value v;
+
+      switch (mrb_type(recv)) {
+      case MRB_TT_ARRAY:
+        if (!mrb_fixnum_p(idx) || !BOP_RECV_P(mrb, recv, array_class, MRB_BOP_ARRAY)) goto L_SEND;
+        {
+          struct RArray *ary = mrb_ary_ptr(recv);
+          mrb_int n = mrb_fixnum(idx);
+
+          if (n < 0) n += ary->len;
+          if (n < 0 || ary->len <= n) {
+            SET_NIL_VALUE(regs[a]);
+          }
+          else {
+            regs[a] = ary->ptr[n];
+          }
+        }
+        break;
+      case MRB_TT_HASH:
+        if (!BOP_RECV_P(mrb, recv, hash_class, MRB_BOP_HASH)) goto L_SEND;
+        v = mrb_hash_get(mrb, recv, idx);
+        /* key#hash or the default proc may have reallocated the stack */
+        regs = mrb->stack;
+        regs[a] = v;
+        break;
+      case MRB_TT_STRING:
+        if (!mrb_fixnum_p(idx) || !BOP_RECV_P(mrb, recv, string_class, MRB_BOP_STRING)) goto L_SEND;
+        v = mrb_str_substr(mrb, recv, mrb_fixnum(idx), 1);
+        if (!mrb_nil_p(v) && RSTRING_LEN(v) == 0) {
+          SET_NIL_VALUE(v);
+        }
+        regs[a] = v;
+        break;
+      default:
+        goto L_SEND;
+      }
+      mrb_gc_arena_restore(mrb, ai);
+      NEXT;
+    }
+
+    CASE(OP_SETIDX) {
+      /* A B C  R(A) := R(A)[R(A+1)]=R(A+2) (Syms[B]=:[]=,C=2)*/
+      int a = GETARG_A(i);
+      mrb_value recv = regs[a];
+      mrb_value idx = regs[a+1];
+      mrb_value v = regs[a+2];
+
+      switch (mrb_type(recv)) {
+      case MRB_TT_ARRAY:
+        if (!mrb_fixnum_p(idx) || !BOP_RECV_P(mrb, recv, array_class, MRB_BOP_ARRAY)) goto L_SEND;
+        mrb_ary_set(mrb, recv, mrb_fixnum(idx), v);
+        break;
+      case MRB_TT_HASH:
+        if (!BOP_RECV_P(mrb, recv, hash_class, MRB_BOP_HASH)) goto L_SEND;
+        mrb_hash_set(mrb, recv, idx, v);
+        regs = mrb->stack;
+        break;
+      default:
+        goto L_SEND;
+      }
+      regs[a] = v;
+      NEXT;
+    }
+
     CASE(OP_ARRAY) {
       /* A B C          R(A) := ary_new(R(B),R(B+1)..R(B+C)) */
       regs[GETARG_A(i)] = mrb_ary_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]);
@@ -1903,7 +2097,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       ci->proc = p;
 
       if (MRB_PROC_CFUNC_P(p)) {
-        mrb->stack[0] = p->body.func(mrb, recv);
+        mrb->stack[0] = MRB_PROC_CFUNC_CALL(mrb, p, recv);
         mrb_gc_arena_restore(mrb, ai);
         if (mrb->exc) goto L_RAISE;
         /* pop stackpos */
@@ -1913,6 +2107,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       }
       else {
         irep = p->body.irep;
+        mrb_irep_materialize(mrb, irep);
         pool = irep->pool;
         syms = irep->syms;
         stack_extend(mrb, irep->nregs, 1);
@@ -1976,7 +2171,7 @@ mrb_run(mrb_state *mrb, struct RProc *proc, mrb_value self)
       {
         int n = mrb->ci->eidx;
 
-        while (n--) {
+        while (n-- > base_eidx) {
           ecall(mrb, n);
         }
       }
@@ -0,0 +1,5 @@
+# packed into IrepTest::MRBC_ARCHIVE as "greet"
+def archive_greet(name)
+  "hello, #{name}"
+end
+archive_greet("archive")
@@ -0,0 +1,2 @@
+# packed into IrepTest::MRBC_ARCHIVE as "util/sum"
+[1, 2, 3, 4].inject(0) { |s, x| s + x }
@@ -1,17 +1,207 @@
 #include <stdlib.h>
+#include <string.h>
 #include "mruby.h"
+#include "mruby/compile.h"
 #include "mruby/irep.h"
 #include "mruby/dump.h"
 #include "mruby/string.h"
 #include "mruby/proc.h"
+#include "mruby/array.h"
 
 extern const uint8_t mrbtest_irep[];
+/* sources under test/archive, packed by mrbc --archive */
+extern const uint8_t mrbtest_archive[];
+extern const size_t mrbtest_archive_size;
 
 void mrbgemtest_init(mrb_state* mrb);
 
+static void
+irep_test_raise(mrb_state *mrb)
+{
+  mrb_value exc = mrb_obj_value(mrb->exc);
+
+  mrb->exc = 0;
+  mrb_exc_raise(mrb, exc);
+}
+
+/* IrepTest.dump(src, flags=0) -> binary image of src */
+static mrb_value
+irep_test_dump(mrb_state *mrb, mrb_value self)
+{
+  char *s;
+  int len, n;
+  mrb_int flags = 0;
+  mrbc_context *c;
+  mrb_value v;
+  mrb_irep *irep;
+  uint8_t *bin;
+  size_t size = 0;
+
+  mrb_get_args(mrb, "s|i", &s, &len, &flags);
+  c = mrbc_context_new(mrb);
+  c->no_exec = 1;
+  /* without a file name there are no line numbers to dump */
+  mrbc_filename(mrb, c, "irep_test.rb");
+  v = mrb_load_nstring_cxt(mrb, s, len, c);
+  mrbc_context_free(mrb, c);
+  if (mrb->exc) irep_test_raise(mrb);
+  irep = mrb->irep[mrb_fixnum(v)];
+  n = mrb_dump_irep(mrb, irep->idx, (int)flags, &bin, &size);
+  /* no proc holds the compiled unit; free it */
+  mrb_irep_incref(irep);
+  mrb_irep_decref(mrb, irep);
+  if (n != MRB_DUMP_OK) {
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "dump error %S", mrb_fixnum_value(n));
+  }
+  v = mrb_str_new(mrb, (char *)bin, size);
+  mrb_free(mrb, bin);
+  return v;
+}
+
+/* images run in place, so they live as long as the mrb_state */
+static const uint8_t*
+irep_test_image(mrb_state *mrb, mrb_value bin)
+{
+  uint8_t *p = (uint8_t *)mrb_alloca(mrb, RSTRING_LEN(bin));
+
+  memcpy(p, RSTRING_PTR(bin), RSTRING_LEN(bin));
+  return p;
+}
+
+/* IrepTest.load(bin, lazy=false) -> value of the program */
+static mrb_value
+irep_test_load(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bin, v;
+  mrb_bool lazy = FALSE;
+  const uint8_t *p;
+  int32_t n;
+
+  mrb_get_args(mrb, "S|b", &bin, &lazy);
+  p = irep_test_image(mrb, bin);
+  n = lazy ? mrb_read_irep_lazy(mrb, p) : mrb_read_irep(mrb, p);
+  if (n < 0) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "irep load error");
+  }
+  /* run at the top level, as mrb_load_irep() would from main() */
+  mrb->ci->target_class = mrb->object_class;
+  v = mrb_run(mrb, mrb_proc_new(mrb, mrb->irep[n]), mrb_top_self(mrb));
+  if (mrb->exc) irep_test_raise(mrb);
+  return v;
+}
+
+/* IrepTest.fix_crc(bin) -> bin with its header CRC-16 recomputed */
+static mrb_value
+irep_test_fix_crc(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bin;
+  struct rite_binary_header *header;
+  size_t n;
+
+  mrb_get_args(mrb, "S", &bin);
+  bin = mrb_str_dup(mrb, bin);
+  header = (struct rite_binary_header *)RSTRING_PTR(bin);
+  n = (uint8_t *)header->binary_size - (uint8_t *)header;
+  if ((size_t)RSTRING_LEN(bin) < sizeof(*header)) return bin;
+  uint16_to_bin(calc_crc_16_ccitt((uint8_t *)header + n, RSTRING_LEN(bin) - n, 0), header->binary_crc);
+  return bin;
+}
+
+/* IrepTest.archive(names, bins) -> archive of the images in bins */
+static mrb_value
+irep_test_archive(mrb_state *mrb, mrb_value self)
+{
+  mrb_value names, bins, v;
+  const char **n;
+  uint8_t **b;
+  size_t *sizes, size;
+  uint8_t *ar;
+  int i, len, result;
+
+  mrb_get_args(mrb, "AA", &names, &bins);
+  len = RARRAY_LEN(names);
+  if (RARRAY_LEN(bins) != len) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "names and bins differ in length");
+  }
+  n = (const char **)mrb_alloca(mrb, sizeof(char *) * (len + 1));
+  b = (uint8_t **)mrb_alloca(mrb, sizeof(uint8_t *) * (len + 1));
+  sizes = (size_t *)mrb_alloca(mrb, sizeof(size_t) * (len + 1));
+  for (i = 0; i < len; i++) {
+    v = mrb_str_to_str(mrb, RARRAY_PTR(bins)[i]);
+    n[i] = mrb_string_value_cstr(mrb, &RARRAY_PTR(names)[i]);
+    b[i] = (uint8_t *)RSTRING_PTR(v);
+    sizes[i] = RSTRING_LEN(v);
+  }
+  result = mrb_dump_archive(mrb, len, n, b, sizes, &ar, &size);
+  if (result == MRB_DUMP_INVALID_ARGUMENT) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "duplicated module name");
+  }
+  if (result != MRB_DUMP_OK) {
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "dump error %S", mrb_fixnum_value(result));
+  }
+  v = mrb_str_new(mrb, (char *)ar, size);
+  mrb_free(mrb, ar);
+  return v;
+}
+
+static mrb_archive*
+irep_test_archive_open(mrb_state *mrb, mrb_value bin)
+{
+  mrb_archive *ar = mrb_archive_new(mrb, irep_test_image(mrb, bin), RSTRING_LEN(bin));
+
+  if (!ar) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "invalid archive");
+  }
+  return ar;
+}
+
+/* IrepTest.archive_include?(archive, name) */
+static mrb_value
+irep_test_archive_include_p(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bin;
+  char *name;
+
+  mrb_get_args(mrb, "Sz", &bin, &name);
+  return mrb_bool_value(mrb_archive_include_p(mrb, irep_test_archive_open(mrb, bin), name));
+}
+
+/* IrepTest.archive_load(archive, name) -> value of the module */
+static mrb_value
+irep_test_archive_load(mrb_state *mrb, mrb_value self)
+{
+  mrb_value bin, v;
+  char *name;
+  mrb_archive *ar;
+
+  mrb_get_args(mrb, "Sz", &bin, &name);
+  ar = irep_test_archive_open(mrb, bin);
+  mrb->ci->target_class = mrb->object_class;
+  v = mrb_archive_load(mrb, ar, name);
+  if (mrb->exc) irep_test_raise(mrb);
+  return v;
+}
+
+static void
+irep_test_init(mrb_state *mrb)
+{
+  struct RClass *m = mrb_define_module(mrb, "IrepTest");
+
+  mrb_define_class_method(mrb, m, "dump", irep_test_dump, MRB_ARGS_ARG(1, 1));
+  mrb_define_class_method(mrb, m, "load", irep_test_load, MRB_ARGS_ARG(1, 1));
+  mrb_define_class_method(mrb, m, "fix_crc", irep_test_fix_crc, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, m, "archive", irep_test_archive, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, m, "archive_include?", irep_test_archive_include_p, MRB_ARGS_REQ(2));
+  mrb_define_class_method(mrb, m, "archive_load", irep_test_archive_load, MRB_ARGS_REQ(2));
+  mrb_define_const(mrb, m, "DUMP_DEBUG_INFO", mrb_fixnum_value(DUMP_DEBUG_INFO));
+  mrb_define_const(mrb, m, "DUMP_CRC32C", mrb_fixnum_value(DUMP_CRC32C));
+  mrb_define_const(mrb, m, "MRBC_ARCHIVE", mrb_str_new(mrb, (const char *)mrbtest_archive, mrbtest_archive_size));
+}
+
 void
 mrb_init_mrbtest(mrb_state *mrb)
 {
+  irep_test_init(mrb);
   mrb_load_irep(mrb, mrbtest_irep);
 #ifndef DISABLE_GEMS
   mrbgemtest_init(mrb);
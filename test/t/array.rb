@@ -319,3 +319,44 @@ assert("Array (Shared Array Corruption)") do
   b.clear
 end
 
+
+assert('Array#[] and #[]= with Fixnum index') do
+  a = [1, 2, 3]
+  i = -1
+  j = 5
+  a[j] = 6
+  a[i] == 6 and a[3] == nil and a[-7] == nil and a == [1, 2, 3, nil, nil, 6]
+end
+
+assert('Array#[]= with Fixnum index on shared array') do
+  a = [1, 2, 3, 4, 5]
+  b = a.slice(1, 3)
+  b[0] = 7
+  a == [1, 2, 3, 4, 5] and b == [7, 3, 4]
+end
+
+assert('Array#[] overridden in subclass and singleton') do
+  class ArrayIndexTest < Array
+    def [](i)
+      :sub
+    end
+  end
+  a = ArrayIndexTest.new
+  b = [1]
+  def b.[]=(i, v)
+    :ignored
+  end
+  b[0] = 2
+  a[0] == :sub and b == [1]
+end
+
+assert('Array#size overridden in subclass') do
+  class ArraySizeTest < Array
+    def size
+      super + 10
+    end
+  end
+  a = ArraySizeTest.new
+  a.push 1
+  a.size == 11 and a.length == 1 and [].empty?
+end
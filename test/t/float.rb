@@ -121,3 +121,17 @@ end
 assert('Float#truncate', '15.2.9.3.15') do
   3.123456789.truncate == 3 and -3.1.truncate == -3
 end
+
+# Not ISO specified
+
+assert('Float literals are loaded exactly') do
+  0.30000000000000004 == 0.1 + 0.2 and
+    1.7976931348623157e+308 > 1.0e308 and
+    2.2250738585072014e-308 / 2 > 0
+end
+
+assert('Float#to_f through the leaf call path') do
+  f = 1.5
+  g = f.to_f
+  g == 1.5 and g.class == Float and (-0.25).to_f == -0.25
+end
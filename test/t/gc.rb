@@ -43,3 +43,176 @@ assert('GC.generational_mode=') do
     GC.generational_mode = origin
   end
 end
+
+assert('GC.malloc_ratio=') do
+  origin = GC.malloc_ratio
+  begin
+    GC.malloc_ratio = 1024
+    GC.malloc_ratio == 1024
+  ensure
+    GC.malloc_ratio = origin
+  end
+end
+
+assert('GC.malloc_increase') do
+  GC.start
+  a = "x" * 100000
+  GC.malloc_increase >= 100000
+end
+
+assert('GC.malloc_increase does not count heap pages') do
+  GC.start
+  GC.disable
+  begin
+    before = GC.malloc_increase
+    pages = GC.stat(:heap_pages)
+    # new heap pages, but no malloc memory for the objects themselves
+    1000.times { Object.new } while GC.stat(:heap_pages) < pages + 4
+    GC.malloc_increase - before < 65536
+  ensure
+    GC.enable
+  end
+end
+
+assert('GC.step_budget_us=') do
+  origin = GC.step_budget_us
+  mode = GC.generational_mode
+  begin
+    GC.generational_mode = false
+    GC.step_budget_us = 100
+    a = []
+    10000.times { |i| a << i.to_s }
+    GC.step_budget_us == 100 and a[9999] == "9999"
+  ensure
+    GC.step_budget_us = origin
+    GC.generational_mode = mode
+  end
+end
+
+assert('GC.freeze_old') do
+  mode = GC.generational_mode
+  begin
+    a = (1..100).map { |i| i.to_s }
+    GC.freeze_old
+    b = (1..1000).map { |i| [i] }
+    GC.start
+    GC.generational_mode and a[99] == "100" and b[999] == [1000]
+  ensure
+    GC.generational_mode = mode
+  end
+end
+
+assert('GC.mark_workers=') do
+  origin = GC.mark_workers
+  begin
+    GC.mark_workers = 4
+    h = {}
+    a = (1..20000).map { |i| h[i] = [i.to_s, {i => i}] }
+    GC.start
+    GC.start
+    a[19999][0] == "20000" and h[12345][1][12345] == 12345 and GC.mark_workers >= 1
+  ensure
+    GC.mark_workers = origin
+  end
+end
+
+assert('GC.concurrent_sweep=') do
+  origin = GC.concurrent_sweep
+  mode = GC.generational_mode
+  begin
+    GC.concurrent_sweep = true
+    r = [true, false].all? do |gen|
+      GC.generational_mode = gen
+      keep = []
+      50000.times { |i| s = "v#{i}"; keep << s if i % 7 == 0 }
+      GC.start
+      keep.size == 7143 and keep[7142] == "v49994"
+    end
+    GC.concurrent_sweep = false
+    r and GC.concurrent_sweep == false
+  ensure
+    GC.concurrent_sweep = origin
+    GC.generational_mode = mode
+  end
+end
+
+assert('GC keeps pool literals across minor GCs') do
+  mode = GC.generational_mode
+  begin
+    GC.generational_mode = true
+    GC.start
+    a = nil
+    20000.times { |i| a = "pool literal" if i % 2 == 0; [i.to_s] }
+    a == "pool literal" and "pool literal".size == 12
+  ensure
+    GC.generational_mode = mode
+  end
+end
+
+assert('GC.trim_threshold=') do
+  origin = GC.trim_threshold
+  begin
+    GC.trim_threshold = 0
+    a = (1..100000).map { |i| i.to_s }
+    a = nil
+    GC.start
+    GC.start
+    b = (1..100000).map { |i| [i] }
+    GC.start
+    b[99999] == [100000] and (GC.trim_threshold == 0 or GC.trim_threshold == origin)
+  ensure
+    GC.trim_threshold = origin
+  end
+end
+
+assert('GC.huge_page_threshold=') do
+  origin = GC.huge_page_threshold
+  begin
+    GC.huge_page_threshold = 1
+    a = (1..50000).map { |i| i.to_s }
+    a[49999] == "50000"
+  ensure
+    GC.huge_page_threshold = origin
+  end
+end
+
+assert('GC.stat') do
+  GC.start
+  s1 = GC.stat
+  100.times { [] }
+  GC.start
+  s2 = GC.stat
+  s2[:count] > s1[:count] and s2[:major_count] > s1[:major_count] and
+    s2[:total_allocated_objects] >= s1[:total_allocated_objects] + 100 and
+    s2[:heap_live_slots] > 0 and s2[:heap_free_slots] >= 0 and
+    GC.stat(:count) == s2[:count] and GC.stat(:no_such_key) == nil
+end
+
+assert('GC.stat(:heap_pages_detail)') do
+  GC.start
+  d = GC.stat(:heap_pages_detail)
+  s = GC.stat
+  d.size == s[:heap_pages] and s[:heap_pages_detail].size >= d.size and
+    d.all? { |e| e.size == 3 and e[0] > 0 and e[1] >= 0 and e[2] >= 0 } and
+    d.inject(0) { |sum, e| sum + e[1] } > 0 and
+    d.inject(0) { |sum, e| sum + e[2] } > 0
+end
+
+assert('GC.latest_info') do
+  GC.start
+  i = GC.latest_info
+  i[:major] == true and i[:full] == true and i[:state] == :none and
+    i[:live_after_mark] > 0 and i[:mark_time_us] >= 0
+end
+
+assert('GC keeps the code of copied procs') do
+  c = Class.new
+  l = nil
+  100.times do |i|
+    b = proc { |x| x + i }
+    l = lambda(&b)
+    c.__send__(:define_method, :m, &b)
+  end
+  GC.start
+  l.call(1) == 100 and c.new.m(2) == 101
+end
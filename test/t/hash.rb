@@ -289,3 +289,59 @@ assert('Hash#inspect') do
 
   ret = "{\"c\"=>300, \"a\"=>100, \"d\"=>400}"
 end
+
+assert('Hash#[] with default proc') do
+  h = Hash.new { |hash, k| hash[k] = k * 2 }
+  k = 21
+  h[k] == 42 and h.keys == [21]
+end
+
+assert('Hash#[] overridden in subclass') do
+  class HashIndexTest < Hash
+    def [](k)
+      :sub
+    end
+  end
+  h = HashIndexTest.new
+  h[1] = 2
+  h[1] == :sub and h.values == [2]
+end
+
+assert('Hash#store with wrong number of arguments') do
+  e1 = e2 = nil
+  h = {}
+  begin
+    h.store(1)
+  rescue ArgumentError => e
+    e1 = e
+  end
+  begin
+    h.store(1, 2, 3)
+  rescue ArgumentError => e
+    e2 = e
+  end
+  e1 and e2 and h.store(1, 2) == 2 and h[1] == 2
+end
+
+assert('Hash#size, #length and #empty? through the leaf call path') do
+  h = {}
+  e = h.empty?
+  h[:a] = 1
+  h[:b] = 2
+  h.delete(:a)
+  e == true and h.size == 1 and h.length == 1 and h.empty? == false
+end
+
+assert('Hash#size redefined in Hash') do
+  class Hash
+    alias_method :__size_orig, :size
+    def size
+      :redefined
+    end
+  end
+  a = {1 => 2}.size
+  class Hash
+    alias_method :size, :__size_orig
+  end
+  a == :redefined and {1 => 2}.size == 1
+end
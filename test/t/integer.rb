@@ -188,3 +188,63 @@ assert('Integer#step') do
   a == [1, 2, 3] and
     b == [1, 3, 5]
 end
+
+assert('Integer#% with negative operands') do
+  a, b = -7, 3
+  (a % b) == 2 and (7 % -3) == -2 and (-7 % -3) == -1 and (b % -1) == 0
+end
+
+assert('Integer bit operators with variables') do
+  x = 0x0f0f
+  y = 0x00ff
+  z = 3
+  (x & y) == 0x0f and (x | y) == 0x0fff and (x ^ y) == 0x0ff0 and
+    (x << z) == 0x7878 and (x >> z) == 0x01e1 and (-x >> 40) == -1 and
+    (x << -z) == 0x01e1 and -x == -3855
+end
+
+assert('Integer operator assignment') do
+  a = 29
+  a %= 8
+  a <<= 2
+  a |= 1
+  a ^= 3
+  a &= 14
+  a >>= 1
+  a == 3
+end
+
+assert('Integer#% redefined') do
+  class Fixnum
+    alias_method :__mod_orig, :%
+    def %(other)
+      :redefined
+    end
+  end
+  a = 7 % 3
+  class Fixnum
+    alias_method :%, :__mod_orig
+  end
+  a == :redefined and 7 % 3 == 1
+end
+
+assert('Integer#~ and #to_f through the leaf call path') do
+  a = 5
+  b = -1
+  ~a == -6 and ~b == 0 and a.to_f == 5.0 and a.to_f.class == Float and
+    b.to_f == -1.0
+end
+
+assert('Integer#~ redefined') do
+  class Fixnum
+    alias_method :__rev_orig, :~
+    def ~
+      :redefined
+    end
+  end
+  a = ~5
+  class Fixnum
+    alias_method :~, :__rev_orig
+  end
+  a == :redefined and ~5 == -6
+end
@@ -0,0 +1,188 @@
+##
+# Bytecode images (IrepTest is defined in test/init_mrbtest.c)
+
+def irep_unhex(hex)
+  (0...hex.size / 2).map { |i| hex[i * 2, 2].to_i(16).chr }.join
+end
+
+# bin with the bytes at i replaced by str
+def irep_patch(bin, i, str)
+  i += bin.size if i < 0
+  bin[0, i] + str + bin[i + str.size..-1]
+end
+
+# bin with the low bit of the byte at i flipped
+def irep_flip(bin, i)
+  irep_patch(bin, i, (bin.bytes[i] ^ 1).chr)
+end
+
+# bin/mrbc -g of "def f(a)\n  a * 2.5\nend\n[f(2), \"s\", :sym, 7, -3]\n"
+# by the compilers writing each older format
+IREP_OLD_IMAGES = {
+  "0001" =>
+    "5249544530303031d87f0000011d4d41545a3030303049524550000000a73030" +
+    "30300002000000000052000100060000000c00800048010002c0008000460080" +
+    "000601400083008000a00100003d018000840240030302bffe03008042b70000" +
+    "004a00000001100001730000000200016600000373796d000000004500030005" +
+    "00000005020000260180400102000002018000b0018000290000000106001632" +
+    "2e35303030303030303030303030303030652b30300000000100012a004c494e" +
+    "4500000058000200000000002d000b2f746d702f6f6c642e72620000000c0003" +
+    "000300030004000400040004000400040004000400040000001f000b2f746d70" +
+    "2f6f6c642e72620000000500030002000200020002454e440000000008",
+  "0002" =>
+    "455449523030303232b0000001214d41545a3030303049524550000000ab3030" +
+    "30300002000000000054000100060000000c010048008000c002000146008000" +
+    "0600800083004001a00080003d000001840080010303400203febf02b7428000" +
+    "4a00000000000001100001730000000200016600000373796d00000000470003" +
+    "0005000000050100260000020140800102000002b00080012900800100000001" +
+    "060016322e35303030303030303030303030303030652b30300000000100012a" +
+    "004c494e4500000058000200000000002d000b2f746d702f6f6c642e72620000" +
+    "000c0003000300030004000400040004000400040004000400040000001f000b" +
+    "2f746d702f6f6c642e72620000000500030002000200020002454e4400000000" +
+    "08",
+  "0003" =>
+    "45544952303030330f48000001114d41545a30303030495245500000009b3030" +
+    "30300002000000000054000100060000000c010048008000c002000146008000" +
+    "0600800083004001a00080003d000001840080010303400203febf02b7428000" +
+    "4a00000000000001000001730000000200016600000373796d00000000370003" +
+    "0005000000050100260000020140800102000002b00080012900800100000001" +
+    "0340040000000000000000000100012a004c494e450000005800020000000000" +
+    "2d000b2f746d702f6f6c642e72620000000c0003000300030004000400040004" +
+    "000400040004000400040000001f000b2f746d702f6f6c642e72620000000500" +
+    "030002000200020002454e440000000008",
+  "0004" =>
+    "4554495230303034fc090000012d4d41545a3030303053594d530000001a0000" +
+    "000300016600000373796d0000012a00495245500000009d3030303000020000" +
+    "00000054000100060000000c0300000048008000c00200014600800006008000" +
+    "83004001a00080003d000001840080010303400203febf02b74280004a000000" +
+    "0000000100000173000000020000000000000001000000390003000500000005" +
+    "03000000260000020140800102000002b0008001290080010000000103400400" +
+    "000000000000000001000000024c494e4500000058000200000000002d000b2f" +
+    "746d702f6f6c642e72620000000c000300030003000400040004000400040004" +
+    "0004000400040000001f000b2f746d702f6f6c642e7262000000050003000200" +
+    "0200020002454e440000000008"
+}
+
+assert('IrepTest.load') do
+  src = "def irep_m(a); a * 2; end; [irep_m(21), 2.5, 'x', :y, 1 << 20]"
+  r = [42, 2.5, 'x', :y, 1 << 20]
+  IrepTest.load(IrepTest.dump(src)) == r and
+    IrepTest.load(IrepTest.dump(src, IrepTest::DUMP_DEBUG_INFO)) == r
+end
+
+assert('IrepTest.load with CRC-32C') do
+  bin = IrepTest.dump("[:crc, 32]", IrepTest::DUMP_CRC32C)
+  bad = irep_flip(bin, -12)
+  bin[22, 4] == "CRCC" and IrepTest.load(bin) == [:crc, 32] and
+    assert_raise(ScriptError) { IrepTest.load(bad) }
+end
+
+assert('IrepTest.load rejects a corrupted image') do
+  bin = IrepTest.dump("[:crc, 16]")
+  assert_raise(ScriptError) { IrepTest.load(irep_flip(bin, -12)) }
+end
+
+assert('IrepTest.load lazily') do
+  src = "def irep_lazy(a); [a].map { |x| x * 3 }; end; [irep_lazy(2), irep_lazy(5)]"
+  IrepTest.load(IrepTest.dump(src), true) == [[6], [15]]
+end
+
+assert('IrepTest.load lazily rejects a bad top-level record') do
+  # no names in SYMS: the symbol index of the top level is out of range
+  bin = IrepTest.dump("[:irep_sym]")
+  bin = IrepTest.fix_crc(irep_patch(bin, 30, "\0\0\0\0"))
+  bin[22, 4] == "SYMS" and
+    assert_raise(ScriptError) { IrepTest.load(bin, true) } and
+    assert_raise(ScriptError) { IrepTest.load(bin) }
+end
+
+assert('IrepTest.load of older formats') do
+  IREP_OLD_IMAGES.all? do |ver, hex|
+    bin = irep_unhex(hex)
+    bin[4, 4] == ver and IrepTest.load(bin) == [5.0, "s", :sym, 7, -3]
+  end
+end
+
+assert('IrepTest.archive') do
+  names = ['b', 'a', 'dir/c']
+  bins = names.map { |n| IrepTest.dump("[:#{n.sub('/', '_')}, #{n.size}]") }
+  ar = IrepTest.archive(names, bins)
+  IrepTest.archive_include?(ar, 'a') and
+    IrepTest.archive_include?(ar, 'dir/c') and
+    !IrepTest.archive_include?(ar, 'c') and
+    IrepTest.archive_load(ar, 'a') == [:a, 1] and
+    IrepTest.archive_load(ar, 'dir/c') == [:dir_c, 5] and
+    assert_raise(ScriptError) { IrepTest.archive_load(ar, 'c') } and
+    assert_raise(ArgumentError) { IrepTest.archive(['a', 'a'], [bins[0], bins[1]]) }
+end
+
+assert('IrepTest.archive rejects unsorted entries') do
+  names = ['a', 'b']
+  ar = IrepTest.archive(names, names.map { |n| IrepTest.dump(":#{n}") })
+  # swap the two 16-byte entries after the header; 'a' is still found
+  # by the binary search, so only the order check rejects it
+  bad = ar[0, 16] + ar[32, 16] + ar[16, 16] + ar[48..-1]
+  IrepTest.archive_load(ar, 'b') == :b and
+    assert_raise(ScriptError) { IrepTest.archive_load(bad, 'a') }
+end
+
+assert('IrepTest.archive of mrbc --archive') do
+  ar = IrepTest::MRBC_ARCHIVE
+  IrepTest.archive_include?(ar, 'greet') and
+    IrepTest.archive_load(ar, 'greet') == "hello, archive" and
+    IrepTest.archive_load(ar, 'util/sum') == 10
+end
+
+def irep_live_slots
+  GC.start
+  GC.stat(:irep_slots) - GC.stat(:irep_free_slots)
+end
+
+def irep_load_procs(n)
+  (0...n).map { |i| IrepTest.load(IrepTest.dump("proc { #{i} }")) }
+end
+
+assert('IrepTest.load frees ireps with their last proc') do
+  bin = IrepTest.dump("[1, 2].map { |x| x * 2 }")
+  10.times { IrepTest.load(bin) }
+  live = irep_live_slots
+  slots = GC.stat(:irep_slots)
+  # the second round reuses the slots the first one freed
+  10.times { IrepTest.load(bin) }
+  irep_live_slots == live and GC.stat(:irep_slots) <= slots
+end
+
+assert('Proc#initialize_copy releases the ireps it replaces') do
+  irep_load_procs(1)
+  live = irep_live_slots
+  a, b = irep_load_procs(2)
+  a.__send__(:initialize_copy, b)
+  r = a.call
+  a = b = nil
+  r == 1 and irep_live_slots == live
+end
+
+assert('IrepTest.load rejects a line table of the wrong length') do
+  bin = IrepTest.dump("[:lines]", IrepTest::DUMP_DEBUG_INFO)
+  # LINE section header (12 bytes), record size, file name, niseq,
+  # table size and the first run, which covers the whole iseq
+  rec = bin.index("LINE") + 12
+  niseq = rec + 6 + (bin.bytes[rec + 4] << 8 | bin.bytes[rec + 5])
+  run = niseq + 8
+  # one instruction more in both niseq and the run: a table that is
+  # consistent by itself, but longer than the iseq
+  bad = irep_patch(bin, niseq + 3, (bin.bytes[niseq + 3] + 1).chr)
+  bad = IrepTest.fix_crc(irep_patch(bad, run, (bin.bytes[run] + 1).chr))
+  IrepTest.load(bin, true) == [:lines] and
+    assert_raise(ScriptError) { IrepTest.load(bad) } and
+    assert_raise(ScriptError) { IrepTest.load(bad, true) }
+end
+
+assert('IrepTest.load rejects an image shorter than its sections') do
+  bin = IrepTest.dump("[:short]", IrepTest::DUMP_CRC32C)
+  # a header whose binary_size (offset 10) claims nothing follows it
+  hdr = IrepTest.fix_crc(irep_patch(bin[0, 22], 10, "\0\0\0\x16"))
+  crcc = IrepTest.fix_crc(irep_patch(bin[0, 26], 10, "\0\0\0\x1a"))
+  assert_raise(ScriptError) { IrepTest.load(hdr) } and
+    assert_raise(ScriptError) { IrepTest.load(crcc) }
+end
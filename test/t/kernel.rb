@@ -266,6 +266,23 @@ assert('Kernel#is_a?', '15.3.1.3.24') do
   is_a?(Kernel) and not is_a?(Array)
 end
 
+assert('Kernel#kind_of? with class hierarchy') do
+  class KindOfA; end
+  class KindOfB < KindOfA; end
+  class KindOfC < KindOfB; end
+  module KindOfM; end
+  c = KindOfC.new
+  b = KindOfB.new
+  r1 = (c.kind_of?(KindOfA) and c.kind_of?(KindOfB) and c.kind_of?(Object))
+  r2 = (not b.kind_of?(KindOfC) and not c.kind_of?(String))
+  class KindOfA
+    include KindOfM
+  end
+  def c.foo; end
+  r3 = (c.kind_of?(KindOfM) and c.kind_of?(KindOfC) and c.kind_of?(KindOfA))
+  r1 and r2 and r3
+end
+
 assert('Kernel#iterator?', '15.3.1.3.25') do
   iterator? == false
 end
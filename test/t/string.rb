@@ -419,3 +419,42 @@ assert('String#inspect') do
   ("\1" * 100).inspect  # should not raise an exception - regress #1210
   "\0".inspect == "\"\\000\""
 end
+
+assert('String#[] with Fixnum index') do
+  s = "hello"
+  i = -1
+  s[i] == "o" and s[0] == "h" and s[5] == nil and s[-6] == nil
+end
+
+assert('String#+ with non-String') do
+  e = nil
+  begin
+    "a" + 1
+  rescue TypeError => x
+    e = x
+  end
+  e and "a" + "b" == "ab"
+end
+
+assert('String#size, #length and #empty? through the leaf call path') do
+  s = ""
+  e = s.empty?
+  s << "abc"
+  e == true and s.size == 3 and s.length == 3 and s.empty? == false and
+    ("a" * 300).size == 300
+end
+
+assert('String#size redefined in String') do
+  class String
+    alias_method :__size_orig, :size
+    def size
+      :redefined
+    end
+  end
+  a = "abc".size
+  b = "abc".length
+  class String
+    alias_method :size, :__size_orig
+  end
+  a == :redefined and b == 3 and "abc".size == 3
+end
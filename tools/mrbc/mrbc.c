@@ -8,6 +8,7 @@
 
 #define RITEBIN_EXT ".mrb"
 #define C_EXT       ".c"
+#define ARCHIVE_EXT ".mar"
 
 void mrb_show_version(mrb_state *);
 void mrb_show_copyright(mrb_state *);
@@ -20,9 +21,13 @@ struct _args {
   char *filename;
   char *initname;
   char *ext;
+  char **infiles;
+  int ninfiles;
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
   mrb_bool debug_info   : 1;
+  mrb_bool crc32c       : 1;
+  mrb_bool archive      : 1;
 };
 
 static void
@@ -35,6 +40,8 @@ usage(const char *name)
   "-v           print version number, then turn on verbose mode",
   "-g           produce debugging information",
   "-B<symbol>   binary <symbol> output in C language format",
+  "--crc32c     verify the binary with CRC-32C instead of CRC-16",
+  "--archive    pack every programfile into one archive (default: .mar)",
   "--verbose    run at verbose mode",
   "--version    print the version",
   "--copyright  print the copyright",
@@ -42,7 +49,7 @@ usage(const char *name)
   };
   const char *const *p = usage_msg;
 
-  printf("Usage: %s [switches] programfile\n", name);
+  printf("Usage: %s [switches] programfile...\n", name);
   while (*p)
     printf("  %s\n", *p++);
 }
@@ -75,6 +82,7 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct _args *args)
 
   *args = args_zero;
   args->ext = RITEBIN_EXT;
+  args->infiles = (char**)mrb_malloc(mrb, sizeof(char*) * argc);
 
   for (argc--,argv++; argc > 0; argc--,argv++) {
     if (**argv == '-') {
@@ -122,6 +130,14 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct _args *args)
           args->verbose = 1;
           break;
         }
+        else if (strcmp((*argv) + 2, "crc32c") == 0) {
+          args->crc32c = 1;
+          break;
+        }
+        else if (strcmp((*argv) + 2, "archive") == 0) {
+          args->archive = 1;
+          break;
+        }
         else if (strcmp((*argv) + 2, "copyright") == 0) {
           mrb_show_copyright(mrb);
           exit(EXIT_SUCCESS);
@@ -132,11 +148,14 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct _args *args)
         break;
       }
     }
-    else if (args->rfp == NULL) {
-      args->filename = infile = *argv;
-      if ((args->rfp = fopen(infile, "r")) == NULL) {
-        printf("%s: Cannot open program file. (%s)\n", *origargv, infile);
-        goto exit;
+    else {
+      args->infiles[args->ninfiles++] = *argv;
+      if (args->rfp == NULL) {
+        args->filename = infile = *argv;
+        if ((args->rfp = fopen(infile, "r")) == NULL) {
+          printf("%s: Cannot open program file. (%s)\n", *origargv, infile);
+          goto exit;
+        }
       }
     }
   }
@@ -145,6 +164,19 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct _args *args)
     result = EXIT_FAILURE;
     goto exit;
   }
+  if (args->archive) {
+    if (args->initname) {
+      printf("%s: -B can not be used with --archive.\n", *origargv);
+      result = EXIT_FAILURE;
+      goto exit;
+    }
+    if (args->ninfiles == 0) {
+      printf("%s: --archive can not read from stdin.\n", *origargv);
+      result = EXIT_FAILURE;
+      goto exit;
+    }
+    args->ext = ARCHIVE_EXT;
+  }
   if (!args->check_syntax) {
     if (outfile == NULL) {
       if (strcmp("-", infile) == 0) {
@@ -176,9 +208,74 @@ cleanup(mrb_state *mrb, struct _args *args)
     fclose(args->rfp);
   if (args->wfp)
     fclose(args->wfp);
+  mrb_free(mrb, args->infiles);
   mrb_close(mrb);
 }
 
+/* compiles each programfile and stores it under its path minus ".rb" */
+static int
+dump_archive(mrb_state *mrb, struct _args *args, int flags)
+{
+  int i, n, result = EXIT_FAILURE;
+  char **names;
+  uint8_t **bins;
+  size_t *sizes, len;
+  uint8_t *archive = NULL;
+  size_t archive_size = 0;
+  FILE *fp;
+  mrbc_context *c;
+  mrb_value v;
+
+  names = (char**)mrb_calloc(mrb, args->ninfiles, sizeof(char*));
+  bins = (uint8_t**)mrb_calloc(mrb, args->ninfiles, sizeof(uint8_t*));
+  sizes = (size_t*)mrb_calloc(mrb, args->ninfiles, sizeof(size_t));
+  for (i = 0; i < args->ninfiles; i++) {
+    if (i == 0) {
+      fp = args->rfp;
+    }
+    else if ((fp = fopen(args->infiles[i], "r")) == NULL) {
+      printf("Cannot open program file. (%s)\n", args->infiles[i]);
+      goto exit;
+    }
+    c = mrbc_context_new(mrb);
+    if (args->verbose)
+      c->dump_result = 1;
+    c->no_exec = 1;
+    c->filename = args->infiles[i];
+    v = mrb_load_file_cxt(mrb, fp, c);
+    mrbc_context_free(mrb, c);
+    if (i > 0) fclose(fp);
+    if (mrb_undef_p(v) || mrb_fixnum(v) < 0) goto exit;
+
+    n = mrb_dump_irep(mrb, mrb_fixnum(v), flags, &bins[i], &sizes[i]);
+    if (n != MRB_DUMP_OK) goto exit;
+    len = strlen(args->infiles[i]);
+    if (len > 3 && strcmp(args->infiles[i] + len - 3, ".rb") == 0) len -= 3;
+    names[i] = (char*)mrb_malloc(mrb, len + 1);
+    memcpy(names[i], args->infiles[i], len);
+    names[i][len] = '\0';
+  }
+  n = mrb_dump_archive(mrb, args->ninfiles, (const char *const *)names, bins, sizes, &archive, &archive_size);
+  if (n == MRB_DUMP_INVALID_ARGUMENT) {
+    printf("Duplicated module name in archive\n");
+    goto exit;
+  }
+  if (n == MRB_DUMP_OK && fwrite(archive, archive_size, 1, args->wfp) == 1) {
+    result = EXIT_SUCCESS;
+  }
+
+exit:
+  for (i = 0; i < args->ninfiles; i++) {
+    mrb_free(mrb, names[i]);
+    mrb_free(mrb, bins[i]);
+  }
+  mrb_free(mrb, names);
+  mrb_free(mrb, bins);
+  mrb_free(mrb, sizes);
+  mrb_free(mrb, archive);
+  return result;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -187,6 +284,7 @@ main(int argc, char **argv)
   struct _args args;
   mrbc_context *c;
   mrb_value result;
+  int flags;
 
   if (mrb == NULL) {
     fputs("Invalid mrb_state, exiting mrbc\n", stderr);
@@ -200,6 +298,13 @@ main(int argc, char **argv)
     return n;
   }
 
+  flags = (args.debug_info ? DUMP_DEBUG_INFO : 0) | (args.crc32c ? DUMP_CRC32C : 0);
+  if (args.archive && !args.check_syntax) {
+    n = dump_archive(mrb, &args, flags);
+    cleanup(mrb, &args);
+    return n;
+  }
+
   c = mrbc_context_new(mrb);
   if (args.verbose)
     c->dump_result = 1;
@@ -216,14 +321,14 @@ main(int argc, char **argv)
     return EXIT_SUCCESS;
   }
   if (args.initname) {
-    n = mrb_dump_irep_cfunc(mrb, n, args.debug_info, args.wfp, args.initname);
+    n = mrb_dump_irep_cfunc(mrb, n, flags, args.wfp, args.initname);
     if (n == MRB_DUMP_INVALID_ARGUMENT) {
       printf("%s: Invalid C language symbol name\n", args.initname);
       return EXIT_FAILURE;
     }
   }
   else {
-    n = mrb_dump_irep_binary(mrb, n, args.debug_info, args.wfp);
+    n = mrb_dump_irep_binary(mrb, n, flags, args.wfp);
   }
 
   cleanup(mrb, &args);